@@ -1,55 +1,470 @@
+#include <algorithm>
+#include <atomic>
+#ifndef MSP_LEAN
 #include <iostream>
-#include <fstream>
+#else
+#include <mutex>
+#endif
 #include <cstdint>
+#include <cstdlib>
+#include <cstdio>
 #include <cstring>
-#include <map>
+#include <functional>
 #include <memory>
+#include <new>
 #include <vector>
 #include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <termios.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <ctime>
+#include <dlfcn.h>
 #include <arpa/inet.h>
+#include <linux/serial.h>
+#include "msp_plugin.h"
+#if defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define MSP_RC_NEON 1
+#endif
 
 using namespace std;
 
 /******************************************************************************
  *                            Constants & Enums
  ******************************************************************************/
-static const int  MSP_MAX_PAYLOAD_SIZE = 256;
-static const int  FRAME_BUFFER_SIZE    = 1024;
-static const int  CHANNEL_COUNT        = 18;
+static const int  MSP_MAX_PAYLOAD_SIZE       = 256;
+static const int  MSP_MAX_JUMBO_PAYLOAD_SIZE = 4096; // MSPv2 and MSPv1 jumbo frames
+static const int  FRAME_BUFFER_SIZE          = 1024;
+static const int  CHANNEL_COUNT              = 18;
+static const int  MSP_COMMAND_COUNT          = 256;  // MSPv1 command IDs fit in one byte
+static const int  ALINK_FLUSH_INTERVAL_MS    = 100;  // max delay of batched alink lines
+static const int  UDP_RECONNECT_INTERVAL_MS  = 1000; // retry of a failed output socket connect()
+static const int  SERIAL_MIN_READ            = 1;    // VMIN: readable on the first queued byte
+static const int  CAPTURE_FLUSH_INTERVAL_MS  = 1000; // max age of staged capture records
+static const int  REPLAY_WINDOW_SIZE         = 64 * 1024 * 1024; // bytes mapped at a time
+static const int  MSP_V1_OVERHEAD            = 6;    // '$' 'M' dir size cmd ... checksum
+static const int  MSP_V2_OVERHEAD            = 9;    // '$' 'X' dir flags cmd16 size16 ... crc
+static const char ALINK_DEFAULT_ADDRESS[]    = "10.5.0.10";
+static const int  ALINK_QUALITY_CHANNEL      = 10;   // RC channel carrying the link quality
+static const int  ALINK_PACKETS_CHANNEL      = 11;   // RC channel with lost/recovered packet counts
+static const int  ALINK_ESTIMATE_RATE_HZ     = 10;   // alink line rate with --alink-estimate, --alink-rate 0
+static const int  FORWARD_FLUSH_INTERVAL_MS  = 100;  // max delay of batched forwarded datagrams
+static const int  FRAME_QUEUE_SIZE           = 512;  // parse -> executor thread ring (frames)
+static const int  POLL_TICK_MS               = 5;    // request scheduler resolution
+static const int  FLEET_BATCH                = 32;   // datagrams per recvmmsg() of a fleet worker
+static const int  FLEET_SWEEP_INTERVAL_MS    = 250;  // fleet idle check and stats refresh
+static const int  RC_VALUE_MIN               = 750;  // plausible RC channel values (us)
+static const int  RC_VALUE_MAX               = 2250;
 
 /**
  * Known MSP commands as a strongly typed enum.
+ * Parsed messages carry the raw command ID, so values without a named
+ * enumerator are valid too.
  */
-enum class MspCommand : uint8_t {
+enum class MspCommand : uint16_t {
     STATUS     = 101,
     ATTITUDE   = 108,
     RC         = 105,
     FC_VARIANT = 102,
-    UNKNOWN    = 255 // fallback
+    UNKNOWN    = 0xFFFF // fallback
 };
 
+/******************************************************************************
+ *                          Console Output & Errors
+ *
+ * The lean profile (-DMSP_LEAN, LEAN=1) is built without iostreams: cout
+ * and cerr are then FdStreams, a small formatter on top of write(2), and
+ * the rest of the program prints the same way in both builds. Like their
+ * std counterparts, cout is buffered until flush() (line by line on a
+ * terminal) and cerr writes through after every insertion.
+ *
+ * Errors are raised with MSP_THROW. Without exceptions (-fno-exceptions,
+ * NOEXCEPT=1) it prints the message and exits instead, which is what every
+ * handler in main() would have done with it; MSP_TRY / MSP_CATCH then
+ * compile to the try block alone.
+ ******************************************************************************/
+#ifdef MSP_LEAN
+class FdStream {
+public:
+    constexpr FdStream(int fd, bool unitBuffered) : m_fd(fd), m_unitBuffered(unitBuffered) {}
+
+    ~FdStream() {
+        flush();
+    }
+
+    FdStream& write(const char* data, size_t size);
+
+    FdStream& flush() {
+        lock_guard<mutex> lock(m_mutex);
+        flushLocked();
+        return *this;
+    }
+
+    FdStream& operator<<(const char* text) {
+        return write(text, strlen(text));
+    }
+
+    FdStream& operator<<(const string& text) {
+        return write(text.data(), text.size());
+    }
+
+    FdStream& operator<<(char c) {
+        return write(&c, 1);
+    }
+
+    template <typename T, typename enable_if<is_integral<T>::value, int>::type = 0>
+    FdStream& operator<<(T value) {
+        return is_signed<T>::value ? writeSigned(static_cast<long long>(value))
+                                   : writeUnsigned(static_cast<unsigned long long>(value));
+    }
+
+    FdStream& operator<<(double value);
+
+private:
+    int    m_fd;
+    bool   m_unitBuffered;
+    int    m_tty   { -1 }; // isatty(m_fd), checked on first use
+    size_t m_used  { 0 };
+    char   m_buffer[1024] {};
+    mutex  m_mutex;
+
+    FdStream& writeSigned(long long value);
+    FdStream& writeUnsigned(unsigned long long value);
+
+    bool lineBuffered() {
+        if (m_tty < 0) {
+            m_tty = isatty(m_fd) ? 1 : 0;
+        }
+        return m_tty == 1;
+    }
+
+    void flushLocked() {
+        writeAll(m_buffer, m_used);
+        m_used = 0;
+    }
+
+    void writeAll(const char* data, size_t size);
+};
+
+// Out of line: each insertion is a call, not an inlined copy of this.
+FdStream& FdStream::write(const char* data, size_t size) {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_used + size > sizeof(m_buffer)) {
+        flushLocked();
+    }
+    if (size > sizeof(m_buffer)) {
+        writeAll(data, size);
+    } else {
+        memcpy(m_buffer + m_used, data, size);
+        m_used += size;
+    }
+    if (m_unitBuffered || (lineBuffered() && memchr(data, '\n', size) != nullptr)) {
+        flushLocked();
+    }
+    return *this;
+}
+
+FdStream& FdStream::writeSigned(long long value) {
+    char text[24];
+    int  length = snprintf(text, sizeof(text), "%lld", value);
+    return write(text, static_cast<size_t>(length));
+}
+
+FdStream& FdStream::writeUnsigned(unsigned long long value) {
+    char text[24];
+    int  length = snprintf(text, sizeof(text), "%llu", value);
+    return write(text, static_cast<size_t>(length));
+}
+
+FdStream& FdStream::operator<<(double value) {
+    char text[32];
+    int  length = snprintf(text, sizeof(text), "%g", value); // ostream's default format
+    return write(text, static_cast<size_t>(length));
+}
+
+void FdStream::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(m_fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return; // nowhere to report it
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+// Constant-initialized, so usable from static constructors and operator new.
+static FdStream cout(STDOUT_FILENO, false);
+static FdStream cerr(STDERR_FILENO, true);
+#endif // MSP_LEAN
+
+#ifdef __cpp_exceptions
+#define MSP_THROW(type, message) throw type(message)
+#define MSP_TRY                  try
+#define MSP_CATCH(e)             catch (const exception& e)
+#else
+#define MSP_THROW(type, message) fatalError(message)
+#define MSP_TRY                  if (true)
+#define MSP_CATCH(e)             else for (const exception& e = exception(); false;)
+
+/**
+ * Prefix for fatal errors, e.g. the config file line being applied.
+ * With exceptions the handlers up the stack add that context instead.
+ */
+string& fatalContext() {
+    static string context;
+    return context;
+}
+
+[[noreturn]] void fatalError(const string& message) {
+    cerr << "[ERROR] " << fatalContext() << message << "\n";
+    cout.flush();
+    _exit(1); // the other threads are still running, skip the destructors
+}
+#endif
+
 /******************************************************************************
  *                           Data Model (Shared State)
  *
  * This struct holds data from the flight controller.
  * Nothing else manipulates how it's stored or interpreted (besides executors).
+ *
+ * Executors update the model in place on the thread that runs them. Other
+ * threads (OSD, telemetry, stats) never touch those fields; they read a
+ * snapshot that the dispatcher publishes through a seqlock after every frame
+ * that changed something. The snapshot generation only moves on a change, so
+ * a consumer can compare it and skip redundant work.
+ *
+ * Consumers on the executor thread can instead subscribe to single fields
+ * with a deadband and get called only when the value moved by more than it.
  ******************************************************************************/
-struct FlightDataModel {
-    bool     armed               { false };
+
+/**
+ * The flight state proper: trivially copyable and free of padding, so it can
+ * be published word by word and compared with memcmp().
+ */
+struct FlightData {
     int16_t  pitch               { 0 };
     int16_t  roll                { 0 };
     int16_t  heading             { 0 };
     uint16_t channels[CHANNEL_COUNT] {};
+    bool     armed               { false };
     char     fcIdentifier[5]     {};  // 4 chars + null terminator
+};
+
+/**
+ * Single-writer seqlock. The sequence is odd while a store is in progress;
+ * readers copy the words and retry if the sequence moved meanwhile. Readers
+ * never block the writer. The payload is kept in relaxed atomic words so
+ * concurrent copies are well defined.
+ */
+template <typename T>
+class Seqlock {
+    static_assert(is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+
+public:
+    /**
+     * Writer: publish a new value.
+     */
+    void store(const T& value) {
+        uint32_t words[WORDS] {};
+        memcpy(words, &value, sizeof(T));
+
+        uint32_t seq = m_seq.load(memory_order_relaxed);
+        m_seq.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i) {
+            m_words[i].store(words[i], memory_order_relaxed);
+        }
+        m_seq.store(seq + 2, memory_order_release);
+    }
+
+    /**
+     * Any thread: copy the latest value. Returns its version (number of
+     * stores so far, 0 = never stored).
+     */
+    uint32_t load(T& out) const {
+        uint32_t words[WORDS];
+        while (true) {
+            uint32_t before = m_seq.load(memory_order_acquire);
+            if (before & 1) {
+                sched_yield(); // writer mid-store, possibly preempted by us
+                continue;
+            }
+            for (size_t i = 0; i < WORDS; ++i) {
+                words[i] = m_words[i].load(memory_order_relaxed);
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (m_seq.load(memory_order_relaxed) == before) {
+                memcpy(&out, words, sizeof(T));
+                return before / 2;
+            }
+        }
+    }
+
+    /**
+     * Version of the last completed store.
+     */
+    uint32_t version() const {
+        return m_seq.load(memory_order_acquire) / 2;
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    atomic<uint32_t> m_seq { 0 };
+    atomic<uint32_t> m_words[WORDS] {};
+};
+
+/**
+ * Fields that can be subscribed to. CHANNEL takes the channel index.
+ */
+enum class FlightField : uint8_t {
+    ARMED,
+    PITCH,
+    ROLL,
+    HEADING,
+    CHANNEL
+};
+
+/**
+ * Change notification: called with the subscriber's context and the new value.
+ */
+using FieldCallback = void (*)(void* context, FlightField field, uint8_t index, int32_t value);
 
+struct FlightDataModel : FlightData {
     bool     verbose            { true };
+
+    // Last RC frame, for executors running after the decoder (bit i = channel i)
+    uint8_t  rcChannelCount     { 0 }; // channels it carried
+    uint32_t rcChanged          { 0 }; // channels whose value changed
+    uint32_t rcRejected         { 0 }; // out-of-range values, previous value kept
+
+    /**
+     * Call 'callback' whenever the field moves by more than 'deadband' from
+     * the value last reported to this subscriber (deadband 0 = any change).
+     * The first publish reports the current value, for an RC channel the
+     * first one after an RC frame carried it. Callbacks run on the
+     * writer thread, right after the frame that caused the change.
+     */
+    void subscribe(FlightField field, uint8_t index, int32_t deadband,
+                   FieldCallback callback, void* context)
+    {
+        if (field == FlightField::CHANNEL && index >= CHANNEL_COUNT) {
+            MSP_THROW(out_of_range, "RC channel outside the model: " + to_string(index));
+        }
+        if (m_subscriptionCount == MAX_SUBSCRIPTIONS) {
+            MSP_THROW(runtime_error, "Too many data model subscriptions");
+        }
+        m_subscriptions[m_subscriptionCount++] = { field, index, deadband, 0, false, callback, context };
+    }
+
+    /**
+     * Writer thread: publish the state if it changed since the last publish,
+     * then notify the subscribers whose field moved past their deadband.
+     */
+    void publish() {
+        const FlightData& current = *this;
+        if (m_snapshot.version() == 0 ||
+            memcmp(&current, &m_lastPublished, sizeof(FlightData)) != 0)
+        {
+            m_snapshot.store(current);
+            m_lastPublished = current;
+            notify();
+        }
+    }
+
+    /**
+     * Any thread: consistent copy of the last published state.
+     * Returns its generation, 0 if nothing was published yet.
+     */
+    uint32_t snapshot(FlightData& out) const {
+        return m_snapshot.load(out);
+    }
+
+    /**
+     * Any thread: generation of the last published state, to cheaply check
+     * for changes before taking a snapshot.
+     */
+    uint32_t generation() const {
+        return m_snapshot.version();
+    }
+
+private:
+    static const size_t MAX_SUBSCRIPTIONS = 16;
+
+    struct Subscription {
+        FlightField   field;
+        uint8_t       index;
+        int32_t       deadband;
+        int32_t       reported;    // value last passed to the callback
+        bool          hasReported;
+        FieldCallback callback;
+        void*         context;
+    };
+
+    Seqlock<FlightData> m_snapshot;
+    FlightData          m_lastPublished;
+    Subscription        m_subscriptions[MAX_SUBSCRIPTIONS] {};
+    size_t              m_subscriptionCount { 0 };
+
+    int32_t fieldValue(FlightField field, uint8_t index) const {
+        switch (field) {
+        case FlightField::ARMED:   return armed;
+        case FlightField::PITCH:   return pitch;
+        case FlightField::ROLL:    return roll;
+        case FlightField::HEADING: return heading;
+        case FlightField::CHANNEL: return channels[index];
+        }
+        return 0;
+    }
+
+    void notify() {
+        for (size_t i = 0; i < m_subscriptionCount; ++i) {
+            Subscription& sub = m_subscriptions[i];
+            if (sub.field == FlightField::CHANNEL && sub.index >= rcChannelCount) {
+                continue; // not carried by an RC frame yet, the 0 means nothing
+            }
+            int32_t value = fieldValue(sub.field, sub.index);
+            int32_t delta = value > sub.reported ? value - sub.reported : sub.reported - value;
+            if (!sub.hasReported || (delta != 0 && delta > sub.deadband)) {
+                sub.reported    = value;
+                sub.hasReported = true;
+                sub.callback(sub.context, sub.field, sub.index, value);
+            }
+        }
+    }
 };
 
 /******************************************************************************
  *                         MSP Message Representation
+ *
+ * A lightweight view of a validated frame. The payload points either into the
+ * caller's receive buffer (frame fully contained in one buffer) or into the
+ * parser's reassembly buffer (frame split across receiveData() calls), so it
+ * is only valid for the duration of the handler call. The same goes for the
+ * raw frame bytes, which are kept for relaying.
  ******************************************************************************/
 struct MspMessage {
     enum class Direction : uint8_t {
@@ -57,11 +472,50 @@ struct MspMessage {
         INBOUND
     };
 
+    enum class Version : uint8_t {
+        V1,
+        V2
+    };
+
     Direction direction { Direction::OUTBOUND };
+    Version    version  { Version::V1 };
     MspCommand cmd      { MspCommand::UNKNOWN };
-    uint8_t    size     { 0 };
-    uint8_t    checksum { 0 };
-    uint8_t    payload[MSP_MAX_PAYLOAD_SIZE] {};
+    uint16_t   size     { 0 };
+    uint8_t    checksum { 0 }; // XOR for MSPv1, CRC8 DVB-S2 for MSPv2
+    const uint8_t* payload { nullptr };
+
+    // The frame exactly as received, '$' to checksum (for MSPv2-over-v1 the
+    // outer MSPv1 frame). Valid as long as the payload.
+    const uint8_t* frame     { nullptr };
+    uint16_t       frameSize { 0 };
+};
+
+/**
+ * Set of command IDs, one bit per ID below MSP_COMMAND_COUNT.
+ * MSPv2 IDs beyond that range are never part of the set.
+ */
+class MspCommandMask {
+public:
+    void set(MspCommand cmd) {
+        uint16_t id = static_cast<uint16_t>(cmd);
+        if (id < MSP_COMMAND_COUNT) {
+            m_bits[id >> 5] |= 1u << (id & 31);
+        }
+    }
+
+    void reset(MspCommand cmd) {
+        uint16_t id = static_cast<uint16_t>(cmd);
+        if (id < MSP_COMMAND_COUNT) {
+            m_bits[id >> 5] &= ~(1u << (id & 31));
+        }
+    }
+
+    bool test(uint16_t id) const {
+        return id < MSP_COMMAND_COUNT && ((m_bits[id >> 5] >> (id & 31)) & 1u);
+    }
+
+private:
+    uint32_t m_bits[MSP_COMMAND_COUNT / 32] {};
 };
 
 /******************************************************************************
@@ -71,6 +525,14 @@ class IMspMessageHandler {
 public:
     virtual ~IMspMessageHandler() = default;
     virtual void onMspMessage(const MspMessage& msg) = 0;
+
+    /**
+     * Commands this handler cares about, or nullptr for all of them.
+     * The parser only validates the checksum of other frames and drops them
+     * without buffering or dispatching. The mask may change after the parser
+     * is created, but must stay at the same address.
+     */
+    virtual const MspCommandMask* interestMask() const { return nullptr; }
 };
 
 /**
@@ -81,488 +543,5872 @@ class IMspCommandExecutor {
 public:
     virtual ~IMspCommandExecutor() = default;
     virtual void execute(const MspMessage& msg, FlightDataModel& dataModel) = 0;
+
+    /**
+     * Short label used in stats output.
+     */
+    virtual const char* name() const { return "executor"; }
+};
+
+/******************************************************************************
+ *                               Byte Order
+ *
+ * MSP fields are little endian and may sit at any offset in a payload.
+ * Always load them byte-wise: compilers turn this into a single load where
+ * that is safe, and it neither traps on strict-alignment cores nor breaks
+ * on big-endian hosts.
+ ******************************************************************************/
+inline uint16_t readLe16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline int16_t readLe16Signed(const uint8_t* p) {
+    return static_cast<int16_t>(readLe16(p));
+}
+
+inline void writeLe16(uint8_t* p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+/******************************************************************************
+ *                               Checksums
+ ******************************************************************************/
+
+/**
+ * XOR of all bytes in a block (MSPv1 checksum), folded a word at a time.
+ */
+uint8_t xorBlock(const uint8_t* data, size_t len) {
+    uint32_t acc = 0;
+    size_t   i   = 0;
+    for (; i + sizeof(acc) <= len; i += sizeof(acc)) {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word)); // alignment-safe load
+        acc ^= word;
+    }
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    uint8_t result = static_cast<uint8_t>(acc);
+    for (; i < len; ++i) {
+        result ^= data[i];
+    }
+    return result;
+}
+
+/**
+ * Lookup table for CRC8 DVB-S2 (polynomial 0xD5), built at compile time.
+ */
+struct Crc8Table {
+    uint8_t entries[256];
 };
 
-/******************************************************************************
- *                           MSP Message Parser
- *
- * Receives raw bytes, reconstructs MspMessage objects, and notifies a handler
- * when a message is fully parsed.
- ******************************************************************************/
-class MspMessageParser {
-public:
-    explicit MspMessageParser(IMspMessageHandler& handler)
-        : m_handler(handler)
-    {
-        reset();
+constexpr Crc8Table makeCrc8DvbS2Table() {
+    Crc8Table table {};
+    for (int i = 0; i < 256; ++i) {
+        uint8_t crc = static_cast<uint8_t>(i);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0xD5)
+                               : static_cast<uint8_t>(crc << 1);
+        }
+        table.entries[i] = crc;
+    }
+    return table;
+}
+
+static constexpr Crc8Table CRC8_DVB_S2 = makeCrc8DvbS2Table();
+
+inline uint8_t crc8DvbS2(uint8_t crc, uint8_t byte) {
+    return CRC8_DVB_S2.entries[crc ^ byte];
+}
+
+/**
+ * CRC8 DVB-S2 (MSPv2 checksum) of a block, continuing from 'crc'.
+ * Unrolled by four so the table lookups of one byte overlap with the
+ * loads of the next.
+ */
+uint8_t crc8DvbS2(uint8_t crc, const uint8_t* data, size_t len) {
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        crc = CRC8_DVB_S2.entries[crc ^ data[i]];
+        crc = CRC8_DVB_S2.entries[crc ^ data[i + 1]];
+        crc = CRC8_DVB_S2.entries[crc ^ data[i + 2]];
+        crc = CRC8_DVB_S2.entries[crc ^ data[i + 3]];
+    }
+    for (; i < len; ++i) {
+        crc = CRC8_DVB_S2.entries[crc ^ data[i]];
+    }
+    return crc;
+}
+
+#ifdef MSP_ARENA
+/******************************************************************************
+ *                            Allocation Arena
+ *
+ * Built with -DMSP_ARENA (ARENA=1 for the platform targets). Global
+ * operator new is replaced by a bump allocator over one static block of
+ * MSP_ARENA_SIZE bytes, so parser, dispatcher, executor and buffer storage
+ * all come from a single reservation instead of fragmenting the heap next
+ * to majestic. Freed arena memory is not reused; everything is allocated
+ * during startup and lives until exit. If the block runs out, allocations
+ * fall back to malloc() and are counted as overflows.
+ *
+ * Every allocation is counted. main() calls arenaMarkSteadyState() right
+ * before the event loop; from then on allocations are also counted as
+ * steady-state ones (stats field steady_allocs), which should stay 0.
+ *
+ * The state is plain constant-initialized globals, usable before any
+ * static constructor runs (iostreams allocate during their own setup).
+ ******************************************************************************/
+#ifndef MSP_ARENA_SIZE
+#define MSP_ARENA_SIZE (4 * 1024 * 1024)
+#endif
+
+alignas(64) static uint8_t g_arenaBlock[MSP_ARENA_SIZE];
+static atomic<size_t>   g_arenaUsed              { 0 };
+static atomic<uint64_t> g_arenaAllocations       { 0 };
+static atomic<uint64_t> g_arenaOverflows         { 0 };
+static atomic<uint64_t> g_arenaSteadyAllocations { 0 };
+static atomic<bool>     g_arenaSteady            { false };
+
+void* arenaAllocate(size_t size, size_t alignment) {
+    g_arenaAllocations.fetch_add(1, memory_order_relaxed);
+    if (g_arenaSteady.load(memory_order_relaxed)) {
+        g_arenaSteadyAllocations.fetch_add(1, memory_order_relaxed);
+    }
+    size = size == 0 ? 1 : size;
+
+    size_t used = g_arenaUsed.load(memory_order_relaxed);
+    while (true) {
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (start + size > MSP_ARENA_SIZE) {
+            break;
+        }
+        if (g_arenaUsed.compare_exchange_weak(used, start + size, memory_order_relaxed)) {
+            return g_arenaBlock + start;
+        }
+    }
+
+    g_arenaOverflows.fetch_add(1, memory_order_relaxed);
+    void* block = nullptr;
+    if (posix_memalign(&block, max(alignment, sizeof(void*)), size) != 0) {
+#ifdef __cpp_exceptions
+        throw bad_alloc();
+#else
+        abort();
+#endif
+    }
+    return block;
+}
+
+void arenaRelease(void* block) {
+    uint8_t* p = static_cast<uint8_t*>(block);
+    if (p < g_arenaBlock || p >= g_arenaBlock + MSP_ARENA_SIZE) {
+        free(block); // an overflow allocation (or nullptr)
+    }
+}
+
+void arenaMarkSteadyState() {
+    g_arenaSteady.store(true, memory_order_relaxed);
+    cerr << "[arena] startup used " << g_arenaUsed.load(memory_order_relaxed) / 1024 << " of "
+         << MSP_ARENA_SIZE / 1024 << " KiB in " << g_arenaAllocations.load(memory_order_relaxed)
+         << " allocations (" << g_arenaOverflows.load(memory_order_relaxed) << " overflowed)\n";
+}
+
+/**
+ * At exit: complain if the steady state wasn't allocation free.
+ */
+void arenaReport() {
+    uint64_t steady = g_arenaSteadyAllocations.load(memory_order_relaxed);
+    if (steady > 0) {
+        cerr << "[arena] WARNING: " << steady << " allocations after startup\n";
+    }
+}
+
+void* operator new(size_t size) {
+    return arenaAllocate(size, alignof(max_align_t));
+}
+
+void* operator new[](size_t size) {
+    return arenaAllocate(size, alignof(max_align_t));
+}
+
+void operator delete(void* block) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete[](void* block) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    arenaRelease(block);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, align_val_t alignment) {
+    return arenaAllocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return arenaAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block, align_val_t) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete[](void* block, align_val_t) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete(void* block, size_t, align_val_t) noexcept {
+    arenaRelease(block);
+}
+
+void operator delete[](void* block, size_t, align_val_t) noexcept {
+    arenaRelease(block);
+}
+#endif
+#endif // MSP_ARENA
+
+/******************************************************************************
+ *                           Runtime Statistics
+ *
+ * Hot-path counters. Every counter has exactly one writer thread (the one
+ * that owns the parser, dispatcher or forwarder it belongs to), so an
+ * increment is a relaxed load + store rather than a locked read-modify-write.
+ * Readers on other threads see a slightly stale but never torn value.
+ ******************************************************************************/
+class StatCounter {
+public:
+    void add(uint64_t n = 1) {
+        m_value.store(m_value.load(memory_order_relaxed) + n, memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return m_value.load(memory_order_relaxed);
+    }
+
+    /**
+     * Keep the largest value seen.
+     */
+    void raise(uint64_t value) {
+        if (value > get()) {
+            m_value.store(value, memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Gauges: publish the writer's current value.
+     */
+    void set(uint64_t value) {
+        m_value.store(value, memory_order_relaxed);
+    }
+
+private:
+    atomic<uint64_t> m_value { 0 };
+};
+
+#ifdef MSP_EXEC_HISTOGRAMS
+/**
+ * Raw monotonic clock for executor timing: not slewed by NTP, so short
+ * intervals are not stretched or shrunk while the clock is adjusted.
+ */
+inline uint64_t latencyClockNs() {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Log2 latency histogram: bucket i counts samples in [2^(i-1), 2^i) ns,
+ * bucket 0 counts 0 ns and the last bucket everything above ~1 s.
+ */
+class LatencyHistogram {
+public:
+    static const size_t BUCKETS = 32;
+
+    void record(uint64_t ns) {
+        size_t bucket = 0;
+        for (uint64_t rest = ns; rest != 0 && bucket < BUCKETS - 1; rest >>= 1) {
+            ++bucket;
+        }
+        m_buckets[bucket].add();
+        m_max.raise(ns);
+    }
+
+    uint64_t bucket(size_t index) const {
+        return m_buckets[index].get();
+    }
+
+    /**
+     * Exclusive upper bound of a bucket in ns.
+     */
+    static uint64_t bucketLimit(size_t index) {
+        return 1ULL << index;
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const StatCounter& bucket : m_buckets) {
+            total += bucket.get();
+        }
+        return total;
+    }
+
+    /**
+     * Upper bound of the bucket holding the given percentile.
+     */
+    uint64_t percentileLimit(unsigned percent) const {
+        uint64_t total  = count();
+        uint64_t target = (total * percent + 99) / 100;
+        uint64_t seen   = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += m_buckets[i].get();
+            if (seen >= target && seen > 0) {
+                return bucketLimit(i);
+            }
+        }
+        return 0;
+    }
+
+    uint64_t max() const {
+        return m_max.get();
+    }
+
+private:
+    StatCounter m_buckets[BUCKETS];
+    StatCounter m_max;
+};
+
+/**
+ * One executor's histogram, labelled for the stats output.
+ */
+struct ExecutorHistogram {
+    uint16_t         command;
+    const char*      executor;
+    LatencyHistogram latency;
+};
+#endif // MSP_EXEC_HISTOGRAMS
+
+struct ParserStats {
+    StatCounter bytes;          // bytes fed to the parser
+    StatCounter frames;         // frames with a valid checksum
+    StatCounter skipped;        // valid frames nobody is interested in
+    StatCounter checksumErrors; // complete frames with a bad checksum
+    StatCounter resyncs;        // bad VERSION/DIRECTION bytes after '$'
+    StatCounter oversize;       // frames dropped for an oversized payload
+};
+
+struct DispatchStats {
+    StatCounter commands[MSP_COMMAND_COUNT]; // dispatched frames per command ID
+    StatCounter beyondTable;                 // MSPv2 commands without executors
+    StatCounter executorNs;                  // time spent in executors
+#ifdef MSP_EXEC_HISTOGRAMS
+    vector< unique_ptr<ExecutorHistogram> > histograms; // in registration order
+#endif
+};
+
+struct SendStats {
+    StatCounter sent;       // datagrams sent
+    StatCounter sendErrors; // failed sendto()/sendmmsg() datagrams
+};
+
+/******************************************************************************
+ *                           MSP Message Parser
+ *
+ * Receives raw bytes, reconstructs MspMessage objects, and notifies a handler
+ * when a message is fully parsed.
+ *
+ * Supported framing:
+ *   MSPv1        $M<dir><size><cmd><payload><xor>
+ *   MSPv1 jumbo  $M<dir><255><cmd><size16><payload><xor>
+ *   MSPv2        $X<dir><flags><cmd16><size16><payload><crc8>
+ *   MSPv2 over v1: an MSPv1 frame with cmd 255 wrapping an MSPv2 body
+ * 16-bit fields are little endian.
+ *
+ * Resynchronisation: when a candidate frame fails (bad VERSION/DIRECTION
+ * byte, oversized payload, checksum mismatch) the bytes it consumed are
+ * rescanned from the next '$' instead of being dropped, so a frame starting
+ * inside a corrupted one is still found. The candidate is already in the
+ * frame buffer; nothing is read from the input twice.
+ ******************************************************************************/
+class MspMessageParser {
+public:
+    explicit MspMessageParser(IMspMessageHandler& handler)
+        : m_handler(handler)
+        , m_interest(handler.interestMask())
+    {
+        reset();
+    }
+
+    /**
+     * Possible states of the MSP parser state machine.
+     * The header states are listed between IDLE and PAYLOAD.
+     */
+    enum class ParserState {
+        IDLE,
+        VERSION,
+        DIRECTION,
+        SIZE,
+        CMD,
+        JUMBO_SIZE_LOW,
+        JUMBO_SIZE_HIGH,
+        V2_FLAGS,
+        V2_CMD_LOW,
+        V2_CMD_HIGH,
+        V2_SIZE_LOW,
+        V2_SIZE_HIGH,
+        PAYLOAD,
+        CHECKSUM
+    };
+
+    /**
+     * Processes a single byte from the input stream.
+     */
+    void processByte(uint8_t byte) {
+        m_stats.bytes.add();
+        consumeByte(byte);
+    }
+
+    /**
+     * Processes a block of bytes from the input stream.
+     *
+     * Behaves exactly like calling processByte() for every byte, but skips
+     * noise between frames with memchr() and consumes the payload in one
+     * block once SIZE is known. Frames that fit entirely inside the block are
+     * validated in place and handed to the handler without copying; a frame
+     * split across several calls is reassembled and resumed where the
+     * previous call left off.
+     */
+    void processBuffer(const uint8_t* data, size_t len) {
+        m_stats.bytes.add(len);
+
+        const uint8_t* p   = data;
+        const uint8_t* end = data + len;
+
+        while (p < end) {
+            switch (m_state) {
+            case ParserState::IDLE: {
+                // Fast scan for the '$' preamble
+                const void* preamble = memchr(p, '$', end - p);
+                if (preamble == nullptr) {
+                    return;
+                }
+                p = static_cast<const uint8_t*>(preamble);
+                if (const uint8_t* next = processInPlace(p, end)) {
+                    p = next;
+                } else {
+                    // Incomplete or malformed header, use the state machine
+                    ++p;
+                    beginFrame();
+                }
+                break;
+            }
+
+            case ParserState::PAYLOAD: {
+                size_t n = min<size_t>(m_msg.size - m_bufPtr, end - p);
+                memcpy(&m_frameBuf[m_headerLen + m_bufPtr], p, n);
+                m_msg.checksum = (m_msg.version == MspMessage::Version::V1)
+                               ? static_cast<uint8_t>(m_msg.checksum ^ xorBlock(p, n))
+                               : crc8DvbS2(m_msg.checksum, p, n);
+                m_bufPtr += n;
+                p        += n;
+                if (m_bufPtr == m_msg.size) {
+                    m_state = ParserState::CHECKSUM;
+                }
+                break;
+            }
+
+            default:
+                // Header and checksum bytes go through the byte-wise path
+                consumeByte(*p++);
+                break;
+            }
+        }
+    }
+
+    const ParserStats& stats() const {
+        return m_stats;
+    }
+
+private:
+    static const uint8_t MSP_JUMBO_FRAME_SIZE = 255; // v1 size marker for a 16-bit size
+    static const uint8_t MSP_V2_FRAME_ID      = 255; // v1 command wrapping an MSPv2 body
+    static const size_t  V1_HEADER_SIZE       = 5;   // '$' 'M' dir size cmd
+    static const size_t  V1_JUMBO_HEADER_SIZE = 7;   // + size16
+    static const size_t  V2_HEADER_SIZE       = 8;   // '$' 'X' dir flags cmd16 size16
+    static const size_t  V2_BODY_HEADER_SIZE  = 5;   // flags cmd16 size16
+
+    IMspMessageHandler& m_handler;
+    ParserState         m_state { ParserState::IDLE };
+    MspMessage          m_msg   {};
+    uint16_t            m_bufPtr{ 0 };
+    bool                m_skip  { false }; // current frame is of no interest
+    const MspCommandMask* m_interest;
+    ParserStats         m_stats;
+    // Reassembly buffer holding the whole frame: header, payload, checksum
+    uint16_t            m_headerLen { 0 };
+    uint8_t             m_frameBuf[V2_HEADER_SIZE + MSP_MAX_JUMBO_PAYLOAD_SIZE + 1] {};
+    // Bytes of failed candidates still to be run through the state machine
+    uint16_t            m_replayPos { 0 };
+    uint16_t            m_replayLen { 0 };
+    uint8_t             m_replay[sizeof(m_frameBuf)] {};
+
+    /**
+     * Advance by one input byte, then by any bytes a failed candidate frame
+     * handed back for rescanning.
+     */
+    void consumeByte(uint8_t byte) {
+        step(byte);
+        while (m_replayPos < m_replayLen) {
+            step(m_replay[m_replayPos++]);
+        }
+    }
+
+    /**
+     * The state machine: advance by one byte.
+     */
+    void step(uint8_t byte) {
+        if (m_state < ParserState::PAYLOAD && m_state != ParserState::IDLE) {
+            m_frameBuf[m_headerLen++] = byte; // header bytes, kept for relaying
+        }
+
+        switch (m_state) {
+        case ParserState::IDLE:
+            if (byte == '$') {
+                beginFrame();
+            }
+            break;
+
+        case ParserState::VERSION:
+            if (byte == 'M') {
+                m_msg.version = MspMessage::Version::V1;
+            } else if (byte == 'X') {
+                m_msg.version = MspMessage::Version::V2;
+            } else {
+                m_stats.resyncs.add();
+                resync(m_headerLen);
+                break;
+            }
+            m_state = ParserState::DIRECTION;
+            break;
+
+        case ParserState::DIRECTION:
+            if (byte == '<') {
+                m_msg.direction = MspMessage::Direction::OUTBOUND;
+            } else if (byte == '>') {
+                m_msg.direction = MspMessage::Direction::INBOUND;
+            } else {
+                m_stats.resyncs.add();
+                resync(m_headerLen);
+                break;
+            }
+            m_state = (m_msg.version == MspMessage::Version::V1) ? ParserState::SIZE
+                                                                 : ParserState::V2_FLAGS;
+            break;
+
+        case ParserState::SIZE:
+            m_msg.size     = byte;
+            m_msg.checksum = byte; // initial checksum includes size
+            m_msg.cmd      = MspCommand::UNKNOWN;
+            m_bufPtr       = 0;
+            if (m_msg.size > MSP_MAX_PAYLOAD_SIZE) {
+                m_stats.oversize.add();
+                resync(m_headerLen);
+            } else {
+                m_state = ParserState::CMD;
+            }
+            break;
+
+        case ParserState::CMD:
+            m_msg.checksum ^= byte;
+            m_msg.cmd       = static_cast<MspCommand>(byte);
+            if (m_msg.size == MSP_JUMBO_FRAME_SIZE) {
+                m_state = ParserState::JUMBO_SIZE_LOW;
+            } else {
+                beginPayload();
+            }
+            break;
+
+        case ParserState::JUMBO_SIZE_LOW:
+            m_msg.checksum ^= byte;
+            m_msg.size      = byte;
+            m_state         = ParserState::JUMBO_SIZE_HIGH;
+            break;
+
+        case ParserState::JUMBO_SIZE_HIGH:
+            m_msg.checksum ^= byte;
+            m_msg.size     |= static_cast<uint16_t>(byte) << 8;
+            if (m_msg.size > MSP_MAX_JUMBO_PAYLOAD_SIZE) {
+                m_stats.oversize.add();
+                resync(m_headerLen);
+            } else {
+                beginPayload();
+            }
+            break;
+
+        case ParserState::V2_FLAGS:
+            m_msg.checksum = crc8DvbS2(0, byte);
+            m_state        = ParserState::V2_CMD_LOW;
+            break;
+
+        case ParserState::V2_CMD_LOW:
+            m_msg.checksum = crc8DvbS2(m_msg.checksum, byte);
+            m_msg.cmd      = static_cast<MspCommand>(byte);
+            m_state        = ParserState::V2_CMD_HIGH;
+            break;
+
+        case ParserState::V2_CMD_HIGH:
+            m_msg.checksum = crc8DvbS2(m_msg.checksum, byte);
+            m_msg.cmd      = static_cast<MspCommand>(static_cast<uint16_t>(m_msg.cmd) | (byte << 8));
+            m_state        = ParserState::V2_SIZE_LOW;
+            break;
+
+        case ParserState::V2_SIZE_LOW:
+            m_msg.checksum = crc8DvbS2(m_msg.checksum, byte);
+            m_msg.size     = byte;
+            m_state        = ParserState::V2_SIZE_HIGH;
+            break;
+
+        case ParserState::V2_SIZE_HIGH:
+            m_msg.checksum = crc8DvbS2(m_msg.checksum, byte);
+            m_msg.size    |= static_cast<uint16_t>(byte) << 8;
+            if (m_msg.size > MSP_MAX_JUMBO_PAYLOAD_SIZE) {
+                m_stats.oversize.add();
+                resync(m_headerLen);
+            } else {
+                beginPayload();
+            }
+            break;
+
+        case ParserState::PAYLOAD:
+            m_frameBuf[m_headerLen + m_bufPtr] = byte;
+            ++m_bufPtr;
+            m_msg.checksum = (m_msg.version == MspMessage::Version::V1)
+                           ? static_cast<uint8_t>(m_msg.checksum ^ byte)
+                           : crc8DvbS2(m_msg.checksum, byte);
+            if (m_bufPtr == m_msg.size) {
+                m_state = ParserState::CHECKSUM;
+            }
+            break;
+
+        case ParserState::CHECKSUM:
+            if (m_msg.checksum != byte) {
+                m_stats.checksumErrors.add();
+                m_frameBuf[m_headerLen + m_msg.size] = byte;
+                resync(m_headerLen + m_msg.size + 1);
+                break;
+            } else if (m_skip) {
+                m_stats.frames.add();
+                m_stats.skipped.add();
+            } else {
+                // Valid message
+                m_stats.frames.add();
+                m_frameBuf[m_headerLen + m_msg.size] = byte;
+                m_msg.payload   = m_frameBuf + m_headerLen;
+                m_msg.frame     = m_frameBuf;
+                m_msg.frameSize = m_headerLen + m_msg.size + 1;
+                deliver();
+            }
+            reset(); // Reset regardless
+            break;
+        }
+    }
+
+    /**
+     * Reset the parser to IDLE state.
+     * Message fields are rewritten from the SIZE state onwards, so there is
+     * nothing to clear here.
+     */
+    void reset() {
+        m_state  = ParserState::IDLE;
+        m_bufPtr = 0;
+    }
+
+    /**
+     * The candidate frame in m_frameBuf[0, length) failed: go back to IDLE
+     * and queue everything from its next '$' for another pass. Bytes not yet
+     * replayed from an earlier failure follow them, so the replay buffer
+     * never holds more than one frame's worth.
+     */
+    void resync(size_t length) {
+        reset();
+        const void* next = memchr(m_frameBuf + 1, '$', length - 1);
+        if (next == nullptr) {
+            return;
+        }
+        size_t rescan  = m_frameBuf + length - static_cast<const uint8_t*>(next);
+        size_t pending = m_replayLen - m_replayPos;
+        memmove(m_replay + rescan, m_replay + m_replayPos, pending);
+        memcpy(m_replay, next, rescan);
+        m_replayPos = 0;
+        m_replayLen = static_cast<uint16_t>(rescan + pending);
+    }
+
+    /**
+     * '$' seen: start collecting a frame.
+     */
+    void beginFrame() {
+        m_frameBuf[0] = '$';
+        m_headerLen   = 1;
+        m_state       = ParserState::VERSION;
+    }
+
+    /**
+     * Header complete: decide whether to deliver the payload and move on.
+     * The payload is buffered either way, a bad checksum rescans it.
+     */
+    void beginPayload() {
+        m_bufPtr = 0;
+        m_skip   = !isInteresting(m_msg);
+        m_state  = (m_msg.size == 0) ? ParserState::CHECKSUM : ParserState::PAYLOAD;
+    }
+
+    /**
+     * Try to handle a frame starting at 'frame' (which points at '$') without
+     * copying it. Returns the position after the frame if a well-formed header
+     * and the whole frame are available (the position after the '$' if its
+     * checksum is bad), nullptr otherwise.
+     */
+    const uint8_t* processInPlace(const uint8_t* frame, const uint8_t* end) {
+        size_t available = static_cast<size_t>(end - frame);
+        if (available < 3) {
+            return nullptr;
+        }
+        if (frame[2] == '<') {
+            m_msg.direction = MspMessage::Direction::OUTBOUND;
+        } else if (frame[2] == '>') {
+            m_msg.direction = MspMessage::Direction::INBOUND;
+        } else {
+            return nullptr;
+        }
+
+        if (frame[1] == 'M') {
+            return processInPlaceV1(frame, available);
+        }
+        if (frame[1] == 'X') {
+            return processInPlaceV2(frame, available);
+        }
+        return nullptr;
+    }
+
+    const uint8_t* processInPlaceV1(const uint8_t* frame, size_t available) {
+        if (available < V1_HEADER_SIZE + 1) {
+            return nullptr;
+        }
+
+        size_t   headerSize = V1_HEADER_SIZE;
+        uint16_t size       = frame[3];
+        uint8_t  checksum   = frame[3] ^ frame[4];
+        if (size == MSP_JUMBO_FRAME_SIZE) {
+            if (available < V1_JUMBO_HEADER_SIZE + 1) {
+                return nullptr;
+            }
+            headerSize = V1_JUMBO_HEADER_SIZE;
+            size       = readLe16(frame + 5);
+            checksum  ^= frame[5] ^ frame[6];
+            if (size > MSP_MAX_JUMBO_PAYLOAD_SIZE) {
+                return nullptr;
+            }
+        }
+        if (available < headerSize + size + 1) {
+            return nullptr;
+        }
+
+        const uint8_t* payload = frame + headerSize;
+        checksum ^= xorBlock(payload, size);
+
+        m_msg.version  = MspMessage::Version::V1;
+        m_msg.cmd      = static_cast<MspCommand>(frame[4]);
+        m_msg.size     = size;
+        m_msg.checksum = checksum;
+        if (checksum != payload[size]) {
+            m_stats.checksumErrors.add();
+            return frame + 1; // resync: rescan the candidate from its next byte
+        }
+        accept(frame, payload);
+        return payload + size + 1;
+    }
+
+    const uint8_t* processInPlaceV2(const uint8_t* frame, size_t available) {
+        if (available < V2_HEADER_SIZE + 1) {
+            return nullptr;
+        }
+        uint16_t size = readLe16(frame + 6);
+        if (size > MSP_MAX_JUMBO_PAYLOAD_SIZE) {
+            return nullptr;
+        }
+        if (available < V2_HEADER_SIZE + size + 1) {
+            return nullptr;
+        }
+
+        const uint8_t* payload = frame + V2_HEADER_SIZE;
+        uint8_t crc = crc8DvbS2(0, frame + 3, V2_BODY_HEADER_SIZE + size);
+
+        m_msg.version  = MspMessage::Version::V2;
+        m_msg.cmd      = static_cast<MspCommand>(readLe16(frame + 4));
+        m_msg.size     = size;
+        m_msg.checksum = crc;
+        if (crc != payload[size]) {
+            m_stats.checksumErrors.add();
+            return frame + 1; // resync: rescan the candidate from its next byte
+        }
+        accept(frame, payload);
+        return payload + size + 1;
+    }
+
+    /**
+     * A frame validated in place: deliver it unless nobody wants it.
+     */
+    void accept(const uint8_t* frame, const uint8_t* payload) {
+        m_stats.frames.add();
+        if (isInteresting(m_msg)) {
+            m_msg.payload   = payload;
+            m_msg.frame     = frame;
+            m_msg.frameSize = static_cast<uint16_t>(payload + m_msg.size + 1 - frame);
+            deliver();
+        } else {
+            m_stats.skipped.add();
+        }
+    }
+
+    /**
+     * Hand a validated message to the handler, unwrapping MSPv2-over-v1.
+     */
+    void deliver() {
+        if (m_msg.version == MspMessage::Version::V1 &&
+            m_msg.cmd == static_cast<MspCommand>(MSP_V2_FRAME_ID))
+        {
+            const uint8_t* body = m_msg.payload;
+            if (m_msg.size < V2_BODY_HEADER_SIZE + 1) {
+                return;
+            }
+            uint16_t size = readLe16(body + 3);
+            if (m_msg.size < V2_BODY_HEADER_SIZE + size + 1) {
+                return;
+            }
+            uint8_t crc = crc8DvbS2(0, body, V2_BODY_HEADER_SIZE + size);
+            if (crc != body[V2_BODY_HEADER_SIZE + size]) {
+                m_stats.checksumErrors.add();
+                return;
+            }
+            m_msg.version  = MspMessage::Version::V2;
+            m_msg.cmd      = static_cast<MspCommand>(readLe16(body + 1));
+            m_msg.size     = size;
+            m_msg.checksum = crc;
+            m_msg.payload  = body + V2_BODY_HEADER_SIZE;
+            if (!isInteresting(m_msg)) {
+                m_stats.skipped.add();
+                return;
+            }
+        }
+        m_handler.onMspMessage(m_msg);
+    }
+
+    /**
+     * Whether frames with this command should be buffered and dispatched.
+     * MSPv2-over-v1 wrappers are always buffered, the wrapped command is
+     * checked once unwrapped.
+     */
+    bool isInteresting(const MspMessage& msg) const {
+        if (msg.version == MspMessage::Version::V1 &&
+            msg.cmd == static_cast<MspCommand>(MSP_V2_FRAME_ID))
+        {
+            return true;
+        }
+        return m_interest == nullptr || m_interest->test(static_cast<uint16_t>(msg.cmd));
+    }
+};
+
+/******************************************************************************
+ *                           MSP Frame Encoding
+ ******************************************************************************/
+
+/**
+ * Write an MSPv1 frame to 'out', which must hold size + MSP_V1_OVERHEAD
+ * bytes. OUTBOUND frames are requests to the flight controller ('<').
+ * Returns the frame length.
+ */
+size_t encodeMspV1(uint8_t* out, MspMessage::Direction direction, uint8_t cmd,
+                   const uint8_t* payload, uint8_t size)
+{
+    out[0] = '$';
+    out[1] = 'M';
+    out[2] = (direction == MspMessage::Direction::OUTBOUND) ? '<' : '>';
+    out[3] = size;
+    out[4] = cmd;
+    if (size > 0) {
+        memcpy(out + 5, payload, size);
+    }
+    out[5 + size] = size ^ cmd ^ xorBlock(payload, size);
+    return size + MSP_V1_OVERHEAD;
+}
+
+/**
+ * Write an MSPv2 frame to 'out', which must hold size + MSP_V2_OVERHEAD
+ * bytes. Returns the frame length.
+ */
+size_t encodeMspV2(uint8_t* out, MspMessage::Direction direction, uint16_t cmd,
+                   const uint8_t* payload, uint16_t size)
+{
+    out[0] = '$';
+    out[1] = 'X';
+    out[2] = (direction == MspMessage::Direction::OUTBOUND) ? '<' : '>';
+    out[3] = 0; // flags
+    out[4] = static_cast<uint8_t>(cmd);
+    out[5] = static_cast<uint8_t>(cmd >> 8);
+    out[6] = static_cast<uint8_t>(size);
+    out[7] = static_cast<uint8_t>(size >> 8);
+    if (size > 0) {
+        memcpy(out + 8, payload, size);
+    }
+    out[8 + size] = crc8DvbS2(0, out + 3, 5 + size);
+    return size + MSP_V2_OVERHEAD;
+}
+
+/******************************************************************************
+ *                              Time Helpers
+ ******************************************************************************/
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds.
+ */
+inline int64_t monotonicNs() {
+    timespec now {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+void sleepNs(int64_t ns) {
+    timespec delay {};
+    delay.tv_sec  = ns / 1000000000LL;
+    delay.tv_nsec = ns % 1000000000LL;
+    while (nanosleep(&delay, &delay) < 0 && errno == EINTR) {
+    }
+}
+
+/******************************************************************************
+ *                           Formatting Helpers
+ ******************************************************************************/
+
+/**
+ * Write the decimal digits of 'value' to 'out' (no terminator).
+ * Returns the number of characters written (at most 20).
+ */
+size_t formatUnsigned(char* out, uint64_t value) {
+    char   digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/******************************************************************************
+ *                           Lock-free SPSC Ring
+ *
+ * Fixed-capacity ring shared by exactly one producer and one consumer thread.
+ * Slots are claimed and published in place, so items are written only once.
+ ******************************************************************************/
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /**
+     * Producer: get the next free slot, or nullptr if the ring is full.
+     * The slot becomes visible to the consumer on publish().
+     */
+    T* claim() {
+        size_t head = m_head.load(memory_order_relaxed);
+        if (head - m_tail.load(memory_order_acquire) == Capacity) {
+            return nullptr;
+        }
+        return &m_items[head & (Capacity - 1)];
+    }
+
+    void publish() {
+        m_head.store(m_head.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+    /**
+     * Consumer: get the oldest published slot, or nullptr if the ring is empty.
+     * The slot is handed back to the producer on release().
+     */
+    T* peek() {
+        size_t tail = m_tail.load(memory_order_relaxed);
+        if (tail == m_head.load(memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_items[tail & (Capacity - 1)];
+    }
+
+    void release() {
+        m_tail.store(m_tail.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+
+private:
+    // Producer and consumer indices on separate cache lines
+    alignas(64) atomic<size_t> m_head { 0 };
+    alignas(64) atomic<size_t> m_tail { 0 };
+    T m_items[Capacity];
+};
+
+/******************************************************************************
+ *                          Asynchronous Log Sink
+ *
+ * Executors run on the parse thread (or the executor thread in pipelined
+ * mode, either way only one thread logs) and must never block on a slow console
+ * (UART, logread pipe). They only fill in compact binary LogRecords; a
+ * background thread formats and writes them. When the ring is full the record
+ * is dropped and counted. Until start() is called records are formatted
+ * synchronously, which keeps tools and early startup output simple.
+ ******************************************************************************/
+enum class LogRecordType : uint8_t {
+    STATUS,
+    ATTITUDE,
+    FC_VARIANT,
+    RC_CHANNELS,
+    ALINK_SENT
+};
+
+struct LogRecord {
+    static const size_t TEXT_SIZE = 64;
+
+    LogRecordType type;
+    uint8_t       count;                  // used entries of values[] or text[]
+    int32_t       values[CHANNEL_COUNT];
+    char          text[TEXT_SIZE];
+};
+
+class AsyncLogSink {
+public:
+    ~AsyncLogSink() {
+        stop();
+    }
+
+    /**
+     * Start the drain thread. Call once during startup.
+     */
+    void start() {
+        if (!m_thread.joinable()) {
+            m_running.store(true, memory_order_relaxed);
+            m_thread = thread(&AsyncLogSink::drainLoop, this);
+        }
+    }
+
+    /**
+     * Write out everything still queued and stop the drain thread.
+     */
+    void stop() {
+        if (m_thread.joinable()) {
+            m_running.store(false, memory_order_relaxed);
+            m_thread.join();
+            drain();
+        }
+        uint64_t dropped = m_dropped.load(memory_order_relaxed);
+        if (dropped != m_droppedReported) {
+            cout << "[AsyncLogSink] Dropped " << dropped - m_droppedReported << " log records\n";
+            m_droppedReported = dropped;
+        }
+        cout.flush();
+    }
+
+    /**
+     * Get a record to fill in, or nullptr if the ring is full.
+     * Every non-null claim() must be followed by commit().
+     */
+    LogRecord* claim(LogRecordType type) {
+        LogRecord* record = m_thread.joinable() ? m_ring.claim() : &m_scratch;
+        if (record == nullptr) {
+            m_dropped.store(m_dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            return nullptr;
+        }
+        record->type  = type;
+        record->count = 0;
+        return record;
+    }
+
+    void commit() {
+        if (m_thread.joinable()) {
+            m_ring.publish();
+        } else {
+            format(m_scratch);
+            cout.flush();
+        }
+    }
+
+    uint64_t dropped() const {
+        return m_dropped.load(memory_order_relaxed);
+    }
+
+private:
+    static const size_t RING_SIZE = 256;
+
+    SpscRing<LogRecord, RING_SIZE> m_ring;
+    LogRecord                      m_scratch {};
+    thread                         m_thread;
+    atomic<bool>                   m_running { false };
+    atomic<uint64_t>               m_dropped { 0 };
+    uint64_t                       m_droppedReported { 0 };
+
+    void drainLoop() {
+        while (m_running.load(memory_order_relaxed)) {
+            if (!drain()) {
+                usleep(10 * 1000); // idle: nothing queued
+            }
+        }
+    }
+
+    /**
+     * Format all queued records. Returns false if there were none.
+     */
+    bool drain() {
+        bool any = false;
+        while (LogRecord* record = m_ring.peek()) {
+            format(*record);
+            m_ring.release();
+            any = true;
+        }
+        if (any) {
+            cout.flush();
+        }
+        return any;
+    }
+
+    static void format(const LogRecord& record) {
+        switch (record.type) {
+        case LogRecordType::STATUS:
+            cout << "[StatusCommandExecutor] Armed = " << record.values[0] << "\n";
+            break;
+
+        case LogRecordType::ATTITUDE:
+            cout << "[AttitudeCommandExecutor] pitch:" << record.values[0]
+                 << " roll:"    << record.values[1]
+                 << " heading:" << record.values[2] << "\n";
+            break;
+
+        case LogRecordType::FC_VARIANT:
+            cout << "[FcVariantCommandExecutor] Flight Controller: ";
+            cout.write(record.text, record.count);
+            cout << "\n";
+            break;
+
+        case LogRecordType::RC_CHANNELS:
+            cout << "[RcCommandConsoleExecutor] Channels:";
+            for (int i = 0; i < record.count; i++) {
+                cout << " " << record.values[i];
+            }
+            cout << "\n";
+            break;
+
+        case LogRecordType::ALINK_SENT:
+            cout << "[RcCommandAlinkForwarder] Sent " << record.values[0]
+                 << " bytes to alink_drone, message: ";
+            cout.write(record.text, record.count);
+            cout << "\n";
+            break;
+        }
+    }
+};
+
+/**
+ * Process-wide log sink used by the executors.
+ */
+AsyncLogSink& logSink() {
+    static AsyncLogSink sink;
+    return sink;
+}
+
+/******************************************************************************
+ *                          RC Channel Decoding
+ *
+ * MSP_RC carries as many little-endian uint16 channels as fit in the
+ * payload (up to CHANNEL_COUNT are kept). Each value is checked against its
+ * channel's range; an implausible value (a glitch the checksum didn't
+ * catch, a failsafe marker) is rejected and the previous one kept. Besides
+ * the values, the decoder reports which channels changed, so later
+ * executors can skip frames that don't touch their channels.
+ *
+ * With NEON (little-endian ARM built with -mfpu=neon) eight channels are
+ * loaded, validated and compared per instruction; unaligned vld1 loads are
+ * fine there.
+ ******************************************************************************/
+struct RcDecodeResult {
+    uint8_t  count    { 0 }; // channels in the payload, at most CHANNEL_COUNT
+    uint32_t changed  { 0 }; // bit i: channel i has a new value
+    uint32_t rejected { 0 }; // bit i: channel i was out of range, kept
+};
+
+static const int RC_LANES = 8; // channels per NEON vector; tables are padded to this
+
+/**
+ * Accepted values per channel. The link channels (quality, packet counters)
+ * are not stick positions and take any value.
+ */
+struct RcChannelRanges {
+    uint16_t min[(CHANNEL_COUNT + RC_LANES - 1) / RC_LANES * RC_LANES];
+    uint16_t max[(CHANNEL_COUNT + RC_LANES - 1) / RC_LANES * RC_LANES];
+
+    RcChannelRanges() {
+        for (size_t i = 0; i < sizeof(min) / sizeof(min[0]); ++i) {
+            bool link = (i == ALINK_QUALITY_CHANNEL || i == ALINK_PACKETS_CHANNEL);
+            min[i] = link ? 0 : RC_VALUE_MIN;
+            max[i] = link ? UINT16_MAX : RC_VALUE_MAX;
+        }
+    }
+};
+
+static const RcChannelRanges RC_CHANNEL_RANGES;
+
+/**
+ * Decode an MSP_RC payload into 'channels' (CHANNEL_COUNT entries holding
+ * the previous values). Channels beyond the payload are left untouched.
+ */
+RcDecodeResult decodeRcChannels(const uint8_t* payload, size_t size, uint16_t* channels) {
+    RcDecodeResult result;
+    size_t count = min<size_t>(size / 2, CHANNEL_COUNT);
+    result.count = static_cast<uint8_t>(count);
+
+    size_t i = 0;
+#ifdef MSP_RC_NEON
+    static const uint16_t LANE_BITS[RC_LANES] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint16x8_t bits = vld1q_u16(LANE_BITS);
+    for (; i + RC_LANES <= count; i += RC_LANES) {
+        uint16x8_t value    = vreinterpretq_u16_u8(vld1q_u8(payload + 2 * i));
+        uint16x8_t previous = vld1q_u16(channels + i);
+        uint16x8_t valid    = vandq_u16(vcgeq_u16(value, vld1q_u16(RC_CHANNEL_RANGES.min + i)),
+                                        vcleq_u16(value, vld1q_u16(RC_CHANNEL_RANGES.max + i)));
+        uint16x8_t next     = vbslq_u16(valid, value, previous);
+        vst1q_u16(channels + i, next);
+
+        // Lane masks -> bitmasks: keep one bit per lane and sum them up
+        uint16x8_t changed  = vandq_u16(vmvnq_u16(vceqq_u16(next, previous)), bits);
+        uint16x8_t rejected = vandq_u16(vmvnq_u16(valid), bits);
+        uint16x4_t sums     = vpadd_u16(vadd_u16(vget_low_u16(changed), vget_high_u16(changed)),
+                                        vadd_u16(vget_low_u16(rejected), vget_high_u16(rejected)));
+        sums = vpadd_u16(sums, sums);
+        result.changed  |= static_cast<uint32_t>(vget_lane_u16(sums, 0)) << i;
+        result.rejected |= static_cast<uint32_t>(vget_lane_u16(sums, 1)) << i;
+    }
+#endif
+    for (; i < count; ++i) {
+        uint16_t value = readLe16(payload + 2 * i);
+        if (value < RC_CHANNEL_RANGES.min[i] || value > RC_CHANNEL_RANGES.max[i]) {
+            result.rejected |= 1u << i;
+        } else if (value != channels[i]) {
+            channels[i]     = value;
+            result.changed |= 1u << i;
+        }
+    }
+    return result;
+}
+
+/******************************************************************************
+ *                      Concrete Command Executors
+ *
+ * Each executor handles a specific MSP command. Extending behavior for new
+ * commands simply requires adding a new executor class implementing
+ * IMspCommandExecutor.
+ ******************************************************************************/
+
+/**
+ * MSP 101 -> STATUS
+ */
+class StatusCommandExecutor final : public IMspCommandExecutor {
+public:
+    static const MspCommand COMMAND = MspCommand::STATUS;
+
+    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
+        // Typically, payload[6] bit 0 indicates "armed" in Betaflight
+        if (msg.size > 6) {
+            dataModel.armed = (msg.payload[6] & 0x01);
+        }
+        if (dataModel.verbose) {
+            if (LogRecord* record = logSink().claim(LogRecordType::STATUS)) {
+                record->values[0] = dataModel.armed;
+                logSink().commit();
+            }
+        }
+    }
+};
+
+/**
+ * MSP 108 -> ATTITUDE
+ */
+class AttitudeCommandExecutor final : public IMspCommandExecutor {
+public:
+    static const MspCommand COMMAND = MspCommand::ATTITUDE;
+
+    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
+        if (msg.size >= 6) {
+            dataModel.roll    = readLe16Signed(&msg.payload[0]);
+            dataModel.pitch   = readLe16Signed(&msg.payload[2]);
+            dataModel.heading = readLe16Signed(&msg.payload[4]);
+            if (dataModel.verbose) {
+                if (LogRecord* record = logSink().claim(LogRecordType::ATTITUDE)) {
+                    record->values[0] = dataModel.pitch;
+                    record->values[1] = dataModel.roll;
+                    record->values[2] = dataModel.heading;
+                    logSink().commit();
+                }
+            }
+        }
+    }
+};
+
+/**
+ * MSP 102 -> FC_VARIANT
+ */
+class FcVariantCommandExecutor final : public IMspCommandExecutor {
+public:
+    static const MspCommand COMMAND = MspCommand::FC_VARIANT;
+
+    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
+        // Usually the first 4 bytes represent the FC variant
+        if (msg.size >= 4) {
+            // Update only if changed
+            if (strncmp(dataModel.fcIdentifier,
+                        reinterpret_cast<const char*>(msg.payload),
+                        4) != 0)
+            {
+                memcpy(dataModel.fcIdentifier, msg.payload, 4);
+                dataModel.fcIdentifier[4] = '\0';
+                if (dataModel.verbose) {
+                    if (LogRecord* record = logSink().claim(LogRecordType::FC_VARIANT)) {
+                        record->count = strlen(dataModel.fcIdentifier);
+                        memcpy(record->text, dataModel.fcIdentifier, record->count);
+                        logSink().commit();
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * We can chain multiple executors for MSP 105 -> RC.
+ * 1) RcCommandConsoleExecutor prints to console,
+ * 2) RcCommandUdpExecutor forwards data via UDP to alink_drone.
+ */
+class RcCommandConsoleExecutor final : public IMspCommandExecutor {
+public:
+    static const MspCommand COMMAND = MspCommand::RC;
+
+    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
+        RcDecodeResult rc = decodeRcChannels(msg.payload, msg.size, dataModel.channels);
+        dataModel.rcChannelCount = rc.count;
+        dataModel.rcChanged      = rc.changed;
+        dataModel.rcRejected     = rc.rejected;
+        if (rc.count > 0 && dataModel.verbose) {
+            if (LogRecord* record = logSink().claim(LogRecordType::RC_CHANNELS)) {
+                for (int i = 0; i < rc.count; i++) {
+                    record->values[i] = dataModel.channels[i];
+                }
+                record->count = rc.count;
+                logSink().commit();
+            }
+        }
+    }
+};
+
+/**
+ * Send 'count' datagrams on a connected socket: send() for one, sendmmsg()
+ * for more. Returns the number sent, -1 on error.
+ *
+ * A connected UDP socket reports an ICMP port unreachable from an earlier
+ * datagram as ECONNREFUSED on the next call (the receiver isn't running
+ * yet). That is expected and only retried, not reported.
+ */
+int sendConnectedBatch(int sock, mmsghdr* msgs, const iovec* iovecs, size_t count) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int sent = 0;
+        if (count == 1) {
+            sent = send(sock, iovecs[0].iov_base, iovecs[0].iov_len, 0) < 0 ? -1 : 1;
+            if (sent == 1) {
+                msgs[0].msg_len = iovecs[0].iov_len;
+            }
+        } else {
+            sent = sendmmsg(sock, msgs, count, 0);
+        }
+        if (sent >= 0) {
+            return sent;
+        }
+        if (errno != ECONNREFUSED) {
+            perror("Failed to send UDP data");
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * UDP socket connect()ed to host:port (IPv4 address), so sends need no
+ * per-packet address. An invalid address or socket() failure throws. A
+ * failed connect() doesn't: on the drone 10.5.0.10 is unreachable until the
+ * wfb interface is up, so the socket stays unconnected, sends fail and are
+ * counted as errors by the caller, and the connect is retried at most every
+ * UDP_RECONNECT_INTERVAL_MS.
+ */
+class ConnectedUdpSocket {
+public:
+    ConnectedUdpSocket(const string& host, int port) {
+        m_addr.sin_family = AF_INET;
+        m_addr.sin_port   = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &m_addr.sin_addr) != 1) {
+            MSP_THROW(invalid_argument, "Invalid destination address: " + host);
+        }
+
+        m_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0) {
+            perror("Failed to create output UDP socket");
+            MSP_THROW(runtime_error, "Output socket creation failed");
+        }
+        if (!connectNow(monotonicNs())) {
+            perror("Failed to connect output UDP socket, retrying");
+        }
+    }
+
+    ~ConnectedUdpSocket() {
+        close(m_fd);
+    }
+
+    ConnectedUdpSocket(const ConnectedUdpSocket&) = delete;
+    ConnectedUdpSocket& operator=(const ConnectedUdpSocket&) = delete;
+
+    /**
+     * sendConnectedBatch() once connected, -1 while the connect keeps failing.
+     */
+    int send(mmsghdr* msgs, const iovec* iovecs, size_t count) {
+        if (!m_connected) {
+            int64_t nowNs = monotonicNs();
+            if (nowNs - m_lastAttemptNs < UDP_RECONNECT_INTERVAL_MS * 1000000LL || !connectNow(nowNs)) {
+                return -1;
+            }
+        }
+        return sendConnectedBatch(m_fd, msgs, iovecs, count);
+    }
+
+private:
+    int         m_fd            { -1 };
+    sockaddr_in m_addr          {};
+    bool        m_connected     { false };
+    int64_t     m_lastAttemptNs { 0 };
+
+    bool connectNow(int64_t monotonicNow) {
+        m_lastAttemptNs = monotonicNow;
+        m_connected     = connect(m_fd, reinterpret_cast<sockaddr*>(&m_addr), sizeof(m_addr)) == 0;
+        return m_connected;
+    }
+};
+
+/**
+ * Packet counts from the link channel: upper 5 bits lost packets, lower
+ * 5 bits recovered (FEC) packets.
+ */
+struct LinkPackets {
+    uint8_t recovered { 0 };
+    uint8_t lost      { 0 };
+};
+
+inline LinkPackets decodeLinkPackets(const FlightDataModel& dataModel) {
+    LinkPackets packets;
+    if (dataModel.rcChannelCount > ALINK_PACKETS_CHANNEL) {
+        uint16_t value    = dataModel.channels[ALINK_PACKETS_CHANNEL];
+        packets.recovered = static_cast<uint8_t>(value & 0x1F);
+        packets.lost      = static_cast<uint8_t>((value >> 5) & 0x1F);
+    }
+    return packets;
+}
+
+/**
+ * Smoothed link statistics for alink_drone, O(1) per RC frame and integers
+ * only: an EWMA (alpha 1/8, 8 fractional bits) of the link quality and of
+ * both packet counts, and the minimum link quality over the last windowMs.
+ * The minimum is kept as the minima of WINDOW_BUCKETS sub-windows, so a dip
+ * is held for one window and then dropped bucket by bucket.
+ */
+class LinkEstimator {
+public:
+    explicit LinkEstimator(int windowMs)
+        : m_bucketNs((windowMs > 0 ? windowMs : 1) * 1000000LL / WINDOW_BUCKETS)
+    {}
+
+    void update(int64_t monotonicNow, uint16_t linkQuality, const LinkPackets& packets) {
+        if (!m_primed) {
+            m_quality       = static_cast<int32_t>(linkQuality) << FRACTION_BITS;
+            m_recovered     = static_cast<int32_t>(packets.recovered) << FRACTION_BITS;
+            m_lost          = static_cast<int32_t>(packets.lost) << FRACTION_BITS;
+            m_bucketStartNs = monotonicNow;
+            m_primed        = true;
+        }
+        else {
+            smooth(m_quality, linkQuality);
+            smooth(m_recovered, packets.recovered);
+            smooth(m_lost, packets.lost);
+            advance(monotonicNow);
+        }
+        if (linkQuality < m_minima[m_bucket]) {
+            m_minima[m_bucket] = linkQuality;
+        }
+    }
+
+    uint16_t quality() const {
+        return toInteger(m_quality);
+    }
+
+    uint16_t minimum() const {
+        uint16_t lowest = UINT16_MAX;
+        for (uint16_t bucketMin : m_minima) {
+            lowest = bucketMin < lowest ? bucketMin : lowest;
+        }
+        return lowest;
+    }
+
+    LinkPackets packets() const {
+        LinkPackets packets;
+        packets.recovered = static_cast<uint8_t>(toInteger(m_recovered));
+        packets.lost      = static_cast<uint8_t>(toInteger(m_lost));
+        return packets;
+    }
+
+private:
+    static const int WINDOW_BUCKETS = 8;
+    static const int FRACTION_BITS  = 8;
+    static const int ALPHA_SHIFT    = 3; // alpha = 1/8
+
+    int64_t  m_bucketNs;
+    int64_t  m_bucketStartNs { 0 };
+    int      m_bucket        { 0 };
+    bool     m_primed        { false };
+    int32_t  m_quality       { 0 };
+    int32_t  m_recovered     { 0 };
+    int32_t  m_lost          { 0 };
+    uint16_t m_minima[WINDOW_BUCKETS] { UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX,
+                                        UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX };
+
+    static void smooth(int32_t& average, uint16_t sample) {
+        average += ((static_cast<int32_t>(sample) << FRACTION_BITS) - average) >> ALPHA_SHIFT;
+    }
+
+    static uint16_t toInteger(int32_t average) {
+        return static_cast<uint16_t>((average + (1 << (FRACTION_BITS - 1))) >> FRACTION_BITS);
+    }
+
+    /**
+     * Start a fresh bucket for every sub-window that has passed; at most
+     * WINDOW_BUCKETS of them are cleared, however long the gap.
+     */
+    void advance(int64_t monotonicNow) {
+        int64_t elapsed = monotonicNow - m_bucketStartNs;
+        if (elapsed < m_bucketNs) {
+            return;
+        }
+        int64_t steps = elapsed / m_bucketNs;
+        m_bucketStartNs += steps * m_bucketNs;
+        for (int64_t i = 0; i < steps && i < WINDOW_BUCKETS; ++i) {
+            m_bucket = (m_bucket + 1) % WINDOW_BUCKETS;
+            m_minima[m_bucket] = UINT16_MAX;
+        }
+    }
+};
+
+/**
+ * Formats alink_drone lines:
+ *   TIMESTAMP:LINK_QUALITY:LINK_QUALITY:RECOVERED_PACKETS:LOST_PACKETS:20:20:20:20
+ * (RSSI values are mocked). The second link quality is the same value, or
+ * the windowed minimum with --alink-estimate. Integers only, no allocation;
+ * the "TIMESTAMP:" prefix is cached for the current wall clock second, read
+ * from CLOCK_REALTIME_COARSE (no syscall).
+ */
+class AlinkLineFormatter {
+public:
+    static const size_t MAX_LINE = 64;
+
+    /**
+     * Write one line (newline terminated, no NUL) to 'out', which must hold
+     * MAX_LINE bytes. Returns its length.
+     */
+    size_t format(char* out, uint16_t linkQuality, uint16_t minQuality, const LinkPackets& packets) {
+        timespec wallClock {};
+        clock_gettime(CLOCK_REALTIME_COARSE, &wallClock);
+        if (wallClock.tv_sec != m_prefixSecond) {
+            m_prefixSecond = wallClock.tv_sec;
+            m_prefixLen    = formatUnsigned(m_prefix, static_cast<uint64_t>(wallClock.tv_sec));
+            m_prefix[m_prefixLen++] = ':';
+        }
+
+        static const char SUFFIX[] = ":20:20:20:20\n";
+
+        size_t len = m_prefixLen;
+        memcpy(out, m_prefix, m_prefixLen);
+        len += formatUnsigned(out + len, linkQuality);
+        out[len++] = ':';
+        len += formatUnsigned(out + len, minQuality);
+        out[len++] = ':';
+        len += formatUnsigned(out + len, packets.recovered);
+        out[len++] = ':';
+        len += formatUnsigned(out + len, packets.lost);
+        memcpy(out + len, SUFFIX, sizeof(SUFFIX) - 1);
+        len += sizeof(SUFFIX) - 1;
+        return len;
+    }
+
+private:
+    time_t m_prefixSecond { -1 };
+    char   m_prefix[24]   {};
+    size_t m_prefixLen    { 0 };
+};
+
+/**
+ * Forwards the RC link quality to alink_drone.
+ *
+ * maxRateHz limits how often an unchanged link quality is re-sent (0 = send
+ * on every RC frame); a change is always sent immediately. With
+ * batchSize > 1 unchanged lines are collected and sent together with
+ * sendmmsg(), while a change flushes the batch right away.
+ *
+ * After subscribe() changes come from a data model subscription with a
+ * deadband instead: jitter within the deadband is not reported, and the last
+ * reported value is only refreshed at maxRateHz (never with 0).
+ *
+ * With estimateWindowMs > 0 every RC frame feeds a LinkEstimator and lines
+ * carry its smoothed values at a steady maxRateHz (ALINK_ESTIMATE_RATE_HZ
+ * for 0) instead of following every raw change.
+ */
+class RcCommandAlinkForwarder : public IMspCommandExecutor {
+public:
+    explicit RcCommandAlinkForwarder(int outPort, int maxRateHz = 0, size_t batchSize = 1,
+                                     const string& destAddress = ALINK_DEFAULT_ADDRESS,
+                                     int estimateWindowMs = 0)
+        : m_minIntervalNs(maxRateHz > 0 ? 1000000000LL / maxRateHz
+                          : (estimateWindowMs > 0 ? 1000000000LL / ALINK_ESTIMATE_RATE_HZ : 0))
+        , m_estimating(estimateWindowMs > 0)
+        , m_estimator(estimateWindowMs)
+        , m_batchSize(batchSize == 0 ? 1 : (batchSize > MAX_BATCH ? MAX_BATCH : batchSize))
+        , m_sock(destAddress, outPort) // alink_drone on the drone by default
+    {
+        for (size_t i = 0; i < MAX_BATCH; ++i) {
+            m_iovecs[i].iov_base = m_lines[i];
+            memset(&m_msgs[i], 0, sizeof(m_msgs[i]));
+            m_msgs[i].msg_hdr.msg_iov    = &m_iovecs[i];
+            m_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    ~RcCommandAlinkForwarder() override {
+        flush();
+    }
+
+    /**
+     * Report link quality changes beyond 'deadband' through the model.
+     */
+    void subscribe(FlightDataModel& model, int32_t deadband) {
+        model.subscribe(FlightField::CHANNEL, ALINK_QUALITY_CHANNEL, deadband,
+                        &RcCommandAlinkForwarder::onLinkQuality, this);
+        m_subscribed = true;
+    }
+
+    void execute(const MspMessage&, FlightDataModel& dataModel) override {
+        if (m_subscribed) {
+            // Changes arrive through onLinkQuality(), only refresh here
+            m_verbose = dataModel.verbose;
+            m_packets = decodeLinkPackets(dataModel);
+            int64_t nowNs = monotonicNs();
+            if (m_hasSent && m_minIntervalNs > 0 && nowNs - m_lastQueuedNs >= m_minIntervalNs) {
+                queueLine(m_lastQuality, m_lastQuality);
+                m_lastQueuedNs = nowNs;
+                if (m_pending == m_batchSize) {
+                    flush();
+                }
+            }
+            return;
+        }
+
+        if (dataModel.rcChannelCount > ALINK_QUALITY_CHANNEL) {
+            // channel 10 is the link quality;
+            // channel 11: upper 5 bits - lost packets, lower 5 bits - recovered packets.
+            // other channels are ignored.
+
+            // output format:
+            // TIMESTAMP:LINK_QUALITY:LINK_QUALITY:RECOVERED_PACKETS:LOST_PACKETS:20:20:20:20 (RSSI values are mocked)
+
+            uint16_t link_quality = dataModel.channels[ALINK_QUALITY_CHANNEL];
+            m_verbose = dataModel.verbose;
+            m_packets = decodeLinkPackets(dataModel);
+
+            int64_t nowNs = monotonicNs();
+
+            if (m_estimating) {
+                // Every frame updates the estimate, lines go out at the fixed rate
+                m_estimator.update(nowNs, link_quality, m_packets);
+                if (m_hasSent && nowNs - m_lastQueuedNs < m_minIntervalNs) {
+                    return;
+                }
+                m_packets = m_estimator.packets();
+                queueLine(m_estimator.quality(), m_estimator.minimum());
+                m_lastQueuedNs = nowNs;
+                m_hasSent      = true;
+                if (m_pending == m_batchSize) {
+                    flush();
+                }
+                return;
+            }
+
+            // Every change is sent, so the decoder's changed bit tells
+            // whether link_quality differs from m_lastQuality
+            bool changed = !m_hasSent || (dataModel.rcChanged & (1u << ALINK_QUALITY_CHANNEL));
+            bool due     = nowNs - m_lastQueuedNs >= m_minIntervalNs;
+            if (!changed && !due) {
+                return; // coalesced: nothing new to tell alink_drone
+            }
+
+            queueLine(link_quality, link_quality);
+            m_lastQuality  = link_quality;
+            m_lastQueuedNs = nowNs;
+            m_hasSent      = true;
+
+            if (changed || m_pending == m_batchSize) {
+                flush();
+            }
+        }
+    }
+
+    const char* name() const override {
+        return "alink";
+    }
+
+    /**
+     * Send all queued lines.
+     */
+    void flush() {
+        if (m_pending == 0) {
+            return;
+        }
+
+        int    sent      = m_sock.send(m_msgs, m_iovecs, m_pending);
+        size_t delivered = sent > 0 ? static_cast<size_t>(sent) : 0;
+        m_stats.sent.add(delivered);
+        m_stats.sendErrors.add(m_pending - delivered);
+        for (size_t i = 0; i < m_pending; ++i) {
+            logSent(i, i < delivered ? static_cast<ssize_t>(m_msgs[i].msg_len) : -1);
+        }
+        m_pending = 0;
+    }
+
+    const SendStats& stats() const {
+        return m_stats;
+    }
+
+private:
+    static const size_t MAX_BATCH = 16;
+    static const size_t LINE_SIZE = AlinkLineFormatter::MAX_LINE;
+
+    SendStats   m_stats;
+
+    int64_t     m_minIntervalNs { 0 };
+    int64_t     m_lastQueuedNs  { 0 };
+    uint16_t    m_lastQuality   { 0 };
+    bool        m_hasSent       { false };
+    bool        m_verbose       { false };
+    bool        m_subscribed    { false };
+    bool        m_estimating    { false };
+    LinkPackets m_packets;
+
+    LinkEstimator      m_estimator;
+    AlinkLineFormatter m_formatter;
+
+    size_t      m_batchSize { 1 };
+    size_t      m_pending   { 0 };
+    char        m_lines[MAX_BATCH][LINE_SIZE] {};
+    iovec       m_iovecs[MAX_BATCH] {};
+    mmsghdr     m_msgs[MAX_BATCH] {};
+    ConnectedUdpSocket m_sock;
+
+    static void onLinkQuality(void* context, FlightField, uint8_t, int32_t value) {
+        auto*   self  = static_cast<RcCommandAlinkForwarder*>(context);
+        int64_t nowNs = monotonicNs();
+        self->queueLine(static_cast<uint16_t>(value), static_cast<uint16_t>(value));
+        self->m_lastQuality  = static_cast<uint16_t>(value);
+        self->m_lastQueuedNs = nowNs;
+        self->m_hasSent      = true;
+        self->flush();
+    }
+
+    /**
+     * Format one alink line into the next batch slot.
+     */
+    void queueLine(uint16_t linkQuality, uint16_t minQuality) {
+        m_iovecs[m_pending].iov_len = m_formatter.format(m_lines[m_pending], linkQuality, minQuality,
+                                                         m_packets);
+        ++m_pending;
+    }
+
+    void logSent(size_t slot, ssize_t sentBytes) {
+        if (m_verbose) {
+            if (LogRecord* record = logSink().claim(LogRecordType::ALINK_SENT)) {
+                record->values[0] = static_cast<int32_t>(sentBytes);
+                record->count     = m_iovecs[slot].iov_len;
+                memcpy(record->text, m_lines[slot], record->count);
+                logSink().commit();
+            }
+        }
+    }
+};
+
+/******************************************************************************
+ *                            Forwarding Engine
+ *
+ * Fans dispatched messages out to any number of UDP destinations, each given
+ * with --forward:
+ *
+ *   host:port[,format=alink|msp|binary|raw][,rate=hz][,decimate=n|cmd:n+..]
+ *            [,cmds=105+108][,deny=182+..][,batch=n]
+ *
+ *   alink   alink_drone line from the RC link quality (RC frames only)
+ *   msp     the message re-framed as MSPv1, or MSPv2 for ids/payloads that
+ *           don't fit
+ *   binary  ForwardBinaryHeader followed by the payload
+ *   raw     relay: the validated frame exactly as received, no re-encoding
+ *
+ * 'rate' limits every command separately (0 = forward every message) and
+ * 'decimate' forwards every n-th message of a command. 'cmds' is the allow
+ * list (default RC for alink, every command for raw, the built-in commands
+ * otherwise) and 'deny' removes commands from it. 'batch' > 1 queues
+ * datagrams for one sendmmsg(). Every destination has its own connect()ed
+ * socket; unbatched raw frames are sent straight from the receive buffer.
+ ******************************************************************************/
+enum class ForwardFormat : uint8_t {
+    ALINK,
+    MSP,
+    BINARY,
+    RAW
+};
+
+/**
+ * Header of the compact binary format, little endian.
+ */
+struct ForwardBinaryHeader {
+    uint32_t timestampMs; // CLOCK_MONOTONIC
+    uint16_t command;
+    uint16_t size;        // payload bytes following the header
+} __attribute__((packed));
+
+struct ForwardSpec {
+    string         host;
+    int            port        { 0 };
+    ForwardFormat  format      { ForwardFormat::ALINK };
+    int            rateHz      { 0 };
+    size_t         batch       { 1 };
+    MspCommandMask commands;
+    bool           hasCommands { false }; // false = format default
+    MspCommandMask denied;
+    uint16_t       decimation[MSP_COMMAND_COUNT]; // forward every n-th message
+
+    ForwardSpec() {
+        fill(begin(decimation), end(decimation), 1);
+    }
+};
+
+class ForwardingEngine {
+public:
+    static const size_t MAX_BATCH = 16;
+
+    /**
+     * Add a destination. Throws if its socket can't be set up.
+     */
+    void addDestination(const ForwardSpec& spec) {
+        auto dest = make_unique<Destination>();
+        dest->sock          = make_unique<ConnectedUdpSocket>(spec.host, spec.port);
+        dest->format        = spec.format;
+        dest->minIntervalNs = spec.rateHz > 0 ? 1000000000LL / spec.rateHz : 0;
+        dest->batch         = spec.batch == 0 ? 1 : (spec.batch > MAX_BATCH ? MAX_BATCH : spec.batch);
+        dest->label         = "fwd" + to_string(m_destinations.size());
+        dest->buffer.resize(dest->batch * SLOT_SIZE);
+
+        MspCommandMask allowed = spec.commands;
+        if (!spec.hasCommands) {
+            if (spec.format == ForwardFormat::ALINK) {
+                allowed.set(MspCommand::RC);
+            } else if (spec.format == ForwardFormat::RAW) {
+                for (uint16_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+                    allowed.set(static_cast<MspCommand>(id));
+                }
+            } else {
+                allowed.set(MspCommand::STATUS);
+                allowed.set(MspCommand::ATTITUDE);
+                allowed.set(MspCommand::RC);
+                allowed.set(MspCommand::FC_VARIANT);
+            }
+        }
+        for (uint16_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+            if (allowed.test(id) && !spec.denied.test(id)) {
+                dest->commands.set(static_cast<MspCommand>(id));
+                m_commands.set(static_cast<MspCommand>(id));
+            }
+        }
+        copy(begin(spec.decimation), end(spec.decimation), dest->decimation);
+
+        for (size_t i = 0; i < dest->batch; ++i) {
+            dest->iovecs[i].iov_base = &dest->buffer[i * SLOT_SIZE];
+            dest->msgs[i].msg_hdr.msg_iov    = &dest->iovecs[i];
+            dest->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        m_destinations.push_back(move(dest));
+    }
+
+    /**
+     * Commands any destination wants; the engine must be registered for each.
+     */
+    const MspCommandMask& commands() const {
+        return m_commands;
+    }
+
+    size_t destinationCount() const {
+        return m_destinations.size();
+    }
+
+    const char* label(size_t index) const {
+        return m_destinations[index]->label.c_str();
+    }
+
+    const SendStats& stats(size_t index) const {
+        return m_destinations[index]->stats;
+    }
+
+    /**
+     * With windowMs > 0 alink destinations send LinkEstimator values (fed
+     * by every RC frame, whatever the destination rates) instead of the
+     * raw link quality, like --alink-estimate does for the alink output.
+     */
+    void setLinkEstimate(int windowMs) {
+        m_estimator.reset(windowMs > 0 ? new LinkEstimator(windowMs) : nullptr);
+    }
+
+    bool batching() const {
+        for (const auto& dest : m_destinations) {
+            if (dest->batch > 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void forward(const MspMessage& msg, const FlightDataModel& dataModel) {
+        uint16_t id    = static_cast<uint16_t>(msg.cmd);
+        int64_t  nowNs = monotonicNs();
+        if (m_estimator && msg.cmd == MspCommand::RC && dataModel.rcChannelCount > ALINK_QUALITY_CHANNEL) {
+            m_estimator->update(nowNs, dataModel.channels[ALINK_QUALITY_CHANNEL], decodeLinkPackets(dataModel));
+        }
+        for (auto& destPtr : m_destinations) {
+            Destination& dest = *destPtr;
+            if (!dest.commands.test(id)) {
+                continue;
+            }
+            if (dest.decimation[id] > 1) {
+                if (++dest.decimationCount[id] < dest.decimation[id]) {
+                    continue;
+                }
+                dest.decimationCount[id] = 0;
+            }
+            if (dest.minIntervalNs > 0) {
+                if (nowNs - dest.lastSentNs[id] < dest.minIntervalNs) {
+                    continue;
+                }
+                dest.lastSentNs[id] = nowNs;
+            }
+
+            if (dest.format == ForwardFormat::RAW && dest.batch == 1) {
+                // Zero copy: one send() straight from the receive buffer
+                iovec frame { const_cast<uint8_t*>(msg.frame), msg.frameSize };
+                int sent = dest.sock->send(dest.msgs, &frame, 1);
+                dest.stats.sent.add(sent > 0 ? 1 : 0);
+                dest.stats.sendErrors.add(sent > 0 ? 0 : 1);
+                continue;
+            }
+
+            uint8_t* slot = &dest.buffer[dest.pending * SLOT_SIZE];
+            size_t   len  = encode(dest, slot, msg, dataModel, nowNs);
+            if (len == 0) {
+                continue;
+            }
+            dest.iovecs[dest.pending].iov_len = len;
+            if (++dest.pending == dest.batch) {
+                send(dest);
+            }
+        }
+    }
+
+    /**
+     * Send everything queued on all destinations.
+     */
+    void flush() {
+        for (auto& dest : m_destinations) {
+            if (dest->pending > 0) {
+                send(*dest);
+            }
+        }
+    }
+
+    ~ForwardingEngine() {
+        flush();
+    }
+
+private:
+    static const size_t SLOT_SIZE = MSP_MAX_JUMBO_PAYLOAD_SIZE + MSP_V2_OVERHEAD + 2; // jumbo v1 frame
+
+    struct Destination {
+        ForwardFormat      format        { ForwardFormat::ALINK };
+        MspCommandMask     commands;
+        int64_t            minIntervalNs { 0 };
+        int64_t            lastSentNs[MSP_COMMAND_COUNT] {};
+        uint16_t           decimation[MSP_COMMAND_COUNT] {};
+        uint16_t           decimationCount[MSP_COMMAND_COUNT] {};
+        size_t             batch         { 1 };
+        size_t             pending       { 0 };
+        vector<uint8_t>    buffer;       // batch slots of SLOT_SIZE
+        iovec              iovecs[MAX_BATCH] {};
+        mmsghdr            msgs[MAX_BATCH] {};
+        AlinkLineFormatter alink;
+        SendStats          stats;
+        string             label;
+        unique_ptr<ConnectedUdpSocket> sock;
+    };
+
+    vector< unique_ptr<Destination> > m_destinations;
+    MspCommandMask                    m_commands;
+    unique_ptr<LinkEstimator>         m_estimator; // alink values, nullptr = raw
+
+    size_t encode(Destination& dest, uint8_t* out, const MspMessage& msg,
+                  const FlightDataModel& dataModel, int64_t nowNs) const
+    {
+        uint16_t id = static_cast<uint16_t>(msg.cmd);
+        switch (dest.format) {
+        case ForwardFormat::ALINK:
+            // Same condition as RcCommandAlinkForwarder: the decoded frame carried the channel
+            if (msg.cmd != MspCommand::RC || dataModel.rcChannelCount <= ALINK_QUALITY_CHANNEL) {
+                return 0;
+            }
+            if (m_estimator) {
+                return dest.alink.format(reinterpret_cast<char*>(out), m_estimator->quality(),
+                                         m_estimator->minimum(), m_estimator->packets());
+            }
+            return dest.alink.format(reinterpret_cast<char*>(out),
+                                     dataModel.channels[ALINK_QUALITY_CHANNEL],
+                                     dataModel.channels[ALINK_QUALITY_CHANNEL],
+                                     decodeLinkPackets(dataModel));
+
+        case ForwardFormat::MSP:
+            if (id < MSP_COMMAND_COUNT && msg.size < 255) {
+                return encodeMspV1(out, msg.direction, static_cast<uint8_t>(id),
+                                   msg.payload, static_cast<uint8_t>(msg.size));
+            }
+            return encodeMspV2(out, msg.direction, id, msg.payload, msg.size);
+
+        case ForwardFormat::RAW:
+            memcpy(out, msg.frame, msg.frameSize);
+            return msg.frameSize;
+
+        case ForwardFormat::BINARY: {
+            ForwardBinaryHeader header;
+            header.timestampMs = static_cast<uint32_t>(nowNs / 1000000);
+            header.command     = id;
+            header.size        = msg.size;
+            memcpy(out, &header, sizeof(header));
+            memcpy(out + sizeof(header), msg.payload, msg.size);
+            return sizeof(header) + msg.size;
+        }
+        }
+        return 0;
+    }
+
+    static void send(Destination& dest) {
+        int sent = dest.sock->send(dest.msgs, dest.iovecs, dest.pending);
+        size_t delivered = sent > 0 ? static_cast<size_t>(sent) : 0;
+        dest.stats.sent.add(delivered);
+        dest.stats.sendErrors.add(dest.pending - delivered);
+        dest.pending = 0;
+    }
+};
+
+/**
+ * Runs the forwarding engine for one command.
+ */
+class ForwardingExecutor final : public IMspCommandExecutor {
+public:
+    explicit ForwardingExecutor(ForwardingEngine& engine)
+        : m_engine(engine)
+    {
+    }
+
+    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
+        m_engine.forward(msg, dataModel);
+    }
+
+    const char* name() const override {
+        return "forward";
+    }
+
+private:
+    ForwardingEngine& m_engine;
+};
+
+/******************************************************************************
+ *                         Static Executor Chain
+ *
+ * Compile-time list of executors. Each executor type declares the command it
+ * handles in a static COMMAND member and is called through its concrete
+ * (final) type, so the calls are direct and can be inlined. The executor
+ * instances live inside the chain itself, no heap allocation is involved.
+ ******************************************************************************/
+template <typename... Executors>
+class StaticExecutorChain;
+
+template <>
+class StaticExecutorChain<> {
+public:
+    static bool handles(MspCommand) { return false; }
+    void dispatch(const MspMessage&, FlightDataModel&) {}
+};
+
+template <typename Head, typename... Tail>
+class StaticExecutorChain<Head, Tail...> {
+public:
+    static bool handles(MspCommand cmd) {
+        return cmd == Head::COMMAND || StaticExecutorChain<Tail...>::handles(cmd);
+    }
+
+    void dispatch(const MspMessage& msg, FlightDataModel& dataModel) {
+        if (msg.cmd == Head::COMMAND) {
+            m_head.execute(msg, dataModel);
+        }
+        m_tail.dispatch(msg, dataModel);
+    }
+
+private:
+    Head                         m_head;
+    StaticExecutorChain<Tail...> m_tail;
+};
+
+/**
+ * The built-in executors, in the order they run for the same command.
+ */
+using BuiltinExecutorChain = StaticExecutorChain<
+    StatusCommandExecutor,
+    AttitudeCommandExecutor,
+    FcVariantCommandExecutor,
+    RcCommandConsoleExecutor
+>;
+
+/******************************************************************************
+ *                        MSP Command Dispatcher
+ *
+ * Dispatch an MspMessage to the executors registered for that command through
+ * a dense table indexed by the raw command ID. Built-in executors run from the
+ * static chain first, then runtime-registered executors (forwarders) in
+ * registration order, then plugin entry points (see msp_plugin.h), which are
+ * plain function pointers resolved at startup. We can add multiple executors
+ * per command (chaining).
+ *
+ * A dispatcher is either bound to one data model, or gets the model with
+ * every message, so one table can serve many streams (fleet mode).
+ ******************************************************************************/
+class MspCommandDispatcher {
+public:
+    explicit MspCommandDispatcher(FlightDataModel& model)
+        : MspCommandDispatcher()
+    {
+        m_dataModel = &model;
+    }
+
+    /**
+     * Unbound: only dispatchMessage(msg, model) may be used.
+     */
+    MspCommandDispatcher() {
+        // Enable base executors
+        enableBuiltin(MspCommand::STATUS);
+        enableBuiltin(MspCommand::ATTITUDE);
+        enableBuiltin(MspCommand::FC_VARIANT);
+        // RC executors will be added externally (in main), demonstrating
+        // Open/Closed for easy extension.
+    }
+
+    /**
+     * Enable the built-in executors for a command.
+     * Returns false if no built-in executor handles it.
+     */
+    bool enableBuiltin(MspCommand cmd) {
+        if (!BuiltinExecutorChain::handles(cmd)) {
+            return false;
+        }
+        uint16_t id = static_cast<uint16_t>(cmd);
+#ifdef MSP_EXEC_HISTOGRAMS
+        if (!m_builtinEnabled[id]) {
+            m_builtinLatency[id] = addHistogram(id, "builtin");
+        }
+#endif
+        m_builtinEnabled[id] = true;
+        m_interest.set(cmd);
+        return true;
+    }
+
+    /**
+     * Stop running the built-in executors for a command.
+     */
+    void disableBuiltin(MspCommand cmd) {
+        uint16_t id = static_cast<uint16_t>(cmd);
+        if (id >= MSP_COMMAND_COUNT || !m_builtinEnabled[id]) {
+            return;
+        }
+        m_builtinEnabled[id] = false;
+        if (m_executors[id].empty() && m_plugins[id].empty()) {
+            m_interest.reset(cmd);
+        }
+    }
+
+    /**
+     * Add an executor for a specific command.
+     * We can add multiple executors for the same command.
+     */
+    void registerExecutor(MspCommand cmd, unique_ptr<IMspCommandExecutor> executor) {
+        uint16_t id = static_cast<uint16_t>(cmd);
+        if (id >= MSP_COMMAND_COUNT) {
+            MSP_THROW(out_of_range, "Command ID outside the dispatch table: " + to_string(id));
+        }
+#ifdef MSP_EXEC_HISTOGRAMS
+        m_latency[id].push_back(addHistogram(id, executor->name()));
+#endif
+        m_executors[id].push_back(move(executor));
+        m_interest.set(cmd);
+    }
+
+    /**
+     * Add a plugin entry point for a command, called after the executors
+     * with a zero-copy msp_plugin_frame view.
+     */
+    void registerPlugin(MspCommand cmd, msp_plugin_frame_fn onFrame, void* context, const char* name) {
+        uint16_t id = static_cast<uint16_t>(cmd);
+        if (id >= MSP_COMMAND_COUNT) {
+            MSP_THROW(out_of_range, "Command ID outside the dispatch table: " + to_string(id));
+        }
+#ifdef MSP_EXEC_HISTOGRAMS
+        m_pluginLatency[id].push_back(addHistogram(id, name));
+#else
+        (void)name;
+#endif
+        m_plugins[id].push_back({ onFrame, context });
+        m_interest.set(cmd);
+    }
+
+    /**
+     * Commands that have at least one executor.
+     */
+    const MspCommandMask& interestMask() const {
+        return m_interest;
+    }
+
+    /**
+     * Dispatch the message to all executors registered for this command.
+     * MSPv2 commands beyond the table have no executors.
+     */
+    void dispatchMessage(const MspMessage& msg) {
+        dispatchMessage(msg, *m_dataModel);
+    }
+
+    /**
+     * Same, updating 'model' instead of the bound one.
+     */
+    void dispatchMessage(const MspMessage& msg, FlightDataModel& model) {
+        uint16_t id = static_cast<uint16_t>(msg.cmd);
+        if (id >= MSP_COMMAND_COUNT) {
+            m_stats.beyondTable.add();
+            return;
+        }
+        m_stats.commands[id].add();
+
+#ifdef MSP_EXEC_HISTOGRAMS
+        // Each clock reading ends one executor's interval and starts the next
+        uint64_t startNs = latencyClockNs();
+        uint64_t lastNs  = startNs;
+        if (m_builtinEnabled[id]) {
+            m_builtins.dispatch(msg, model);
+            uint64_t nowNs = latencyClockNs();
+            m_builtinLatency[id]->record(nowNs - lastNs);
+            lastNs = nowNs;
+        }
+        for (size_t i = 0; i < m_executors[id].size(); ++i) {
+            m_executors[id][i]->execute(msg, model);
+            uint64_t nowNs = latencyClockNs();
+            m_latency[id][i]->record(nowNs - lastNs);
+            lastNs = nowNs;
+        }
+        if (!m_plugins[id].empty()) {
+            msp_plugin_frame view = pluginView(msg);
+            for (size_t i = 0; i < m_plugins[id].size(); ++i) {
+                m_plugins[id][i].onFrame(m_plugins[id][i].context, &view);
+                uint64_t nowNs = latencyClockNs();
+                m_pluginLatency[id][i]->record(nowNs - lastNs);
+                lastNs = nowNs;
+            }
+        }
+        m_stats.executorNs.add(lastNs - startNs);
+        model.publish();
+#else
+        int64_t startNs = m_timed ? monotonicNs() : 0;
+        if (m_builtinEnabled[id]) {
+            m_builtins.dispatch(msg, model);
+        }
+        for (auto& exec : m_executors[id]) {
+            exec->execute(msg, model);
+        }
+        if (!m_plugins[id].empty()) {
+            msp_plugin_frame view = pluginView(msg);
+            for (const PluginCall& plugin : m_plugins[id]) {
+                plugin.onFrame(plugin.context, &view);
+            }
+        }
+        if (m_timed) {
+            m_stats.executorNs.add(monotonicNs() - startNs);
+        }
+        model.publish();
+#endif
+        // if (!m_builtinEnabled[id] && m_executors[id].empty() && model.verbose) {
+        //     cout << "[MspCommandDispatcher] Unhandled command: " 
+        //          << static_cast<int>(msg.cmd) << "\n";
+        // }
+    }
+
+    const DispatchStats& stats() const {
+        return m_stats;
+    }
+
+    /**
+     * Count the time spent in executors (exec_us). Off by default: it costs
+     * two clock reads per frame. Histogram builds always time every call.
+     */
+    void setTimed(bool timed) {
+        m_timed = timed;
+    }
+
+private:
+    struct PluginCall {
+        msp_plugin_frame_fn onFrame;
+        void*               context;
+    };
+
+    FlightDataModel*     m_dataModel { nullptr };
+    BuiltinExecutorChain m_builtins;
+    DispatchStats        m_stats;
+    bool                 m_timed { false };
+    bool                 m_builtinEnabled[MSP_COMMAND_COUNT] {};
+    MspCommandMask       m_interest;
+    // Each command can have multiple executors
+    vector< unique_ptr<IMspCommandExecutor> > m_executors[MSP_COMMAND_COUNT];
+    vector<PluginCall>   m_plugins[MSP_COMMAND_COUNT];
+#ifdef MSP_EXEC_HISTOGRAMS
+    // Parallel to m_builtinEnabled / m_executors / m_plugins, owned by m_stats
+    LatencyHistogram*          m_builtinLatency[MSP_COMMAND_COUNT] {};
+    vector<LatencyHistogram*>  m_latency[MSP_COMMAND_COUNT];
+    vector<LatencyHistogram*>  m_pluginLatency[MSP_COMMAND_COUNT];
+
+    LatencyHistogram* addHistogram(uint16_t id, const char* executor) {
+        unique_ptr<ExecutorHistogram> histogram(new ExecutorHistogram { id, executor, {} });
+        LatencyHistogram* latency = &histogram->latency;
+        m_stats.histograms.push_back(move(histogram));
+        return latency;
+    }
+#endif
+
+    static msp_plugin_frame pluginView(const MspMessage& msg) {
+        msp_plugin_frame view;
+        view.command    = static_cast<uint16_t>(msg.cmd);
+        view.size       = msg.size;
+        view.version    = (msg.version == MspMessage::Version::V1) ? 1 : 2;
+        view.direction  = (msg.direction == MspMessage::Direction::OUTBOUND) ? '<' : '>';
+        view.frame_size = msg.frameSize;
+        view.payload    = msg.payload;
+        view.frame      = msg.frame;
+        return view;
+    }
+};
+
+/******************************************************************************
+ *                     MSP Message Handler Implementation
+ *
+ * Single Responsibility: Implementation of IMspMessageHandler. Receives fully
+ * parsed messages and dispatches them to appropriate executors.
+ ******************************************************************************/
+class MspMessageHandler : public IMspMessageHandler {
+public:
+    explicit MspMessageHandler(FlightDataModel& model)
+        : m_dataModel(model)
+        , m_dispatcher(model)
+    {
+    }
+
+    void onMspMessage(const MspMessage& msg) override {
+        // if (m_dataModel.verbose) {
+        //     cout << "[MspMessageHandler] Received MSP msg: cmd="
+        //          << static_cast<int>(msg.cmd)
+        //          << ", size=" << static_cast<int>(msg.size) << "\n";
+        // }
+
+        // Dispatch to all interested executors
+        m_dispatcher.dispatchMessage(msg);
+    }
+
+    const MspCommandMask* interestMask() const override {
+        return &m_dispatcher.interestMask();
+    }
+
+    /**
+     * Allow external configuration of the command dispatcher.
+     * This is how we register new executors without changing the class.
+     */
+    MspCommandDispatcher& getDispatcher() {
+        return m_dispatcher;
+    }
+
+private:
+    FlightDataModel&      m_dataModel;
+    MspCommandDispatcher  m_dispatcher;
+};
+
+/******************************************************************************
+ *                            Executor Plugins
+ *
+ * A shared object implementing the msp_plugin.h ABI, loaded with dlopen().
+ * Its entry point runs once here; attach() then puts its frame callback
+ * into the dispatcher's table for every command it asked for. The library
+ * stays loaded for the lifetime of this object and is shut down and
+ * unloaded with it, so it must outlive the dispatcher's last frame.
+ ******************************************************************************/
+class PluginLibrary {
+public:
+    PluginLibrary(const string& path, const string& args)
+        : m_path(path)
+    {
+        m_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (m_handle == nullptr) {
+            MSP_THROW(runtime_error, "Failed to load plugin: " + string(dlerror()));
+        }
+
+        auto init = reinterpret_cast<msp_plugin_init_fn>(dlsym(m_handle, MSP_PLUGIN_ENTRY));
+        if (init == nullptr) {
+            fail("no " MSP_PLUGIN_ENTRY "() entry point");
+        }
+        memset(&m_plugin, 0, sizeof(m_plugin));
+        int result = init(&m_plugin, args.c_str());
+        if (result != 0) {
+            fail(MSP_PLUGIN_ENTRY "() failed with " + to_string(result));
+        }
+        if (m_plugin.abi_version != MSP_PLUGIN_ABI_VERSION) {
+            fail("built for plugin ABI " + to_string(m_plugin.abi_version) +
+                 ", expected " + to_string(MSP_PLUGIN_ABI_VERSION));
+        }
+        m_initialized = true;
+        if (m_plugin.on_frame == nullptr) {
+            fail("no on_frame callback");
+        }
+        if (m_plugin.name == nullptr) {
+            m_plugin.name = "plugin";
+        }
+        cout << "[PluginLibrary] Loaded " << m_plugin.name << " from " << path << "\n";
+    }
+
+    ~PluginLibrary() {
+        unload();
+    }
+
+    PluginLibrary(const PluginLibrary&)            = delete;
+    PluginLibrary& operator=(const PluginLibrary&) = delete;
+
+    /**
+     * Register the plugin for its commands. Returns how many it asked for.
+     */
+    size_t attach(MspCommandDispatcher& dispatcher) const {
+        size_t count = 0;
+        for (uint16_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+            if ((m_plugin.commands[id >> 5] >> (id & 31)) & 1u) {
+                dispatcher.registerPlugin(static_cast<MspCommand>(id), m_plugin.on_frame,
+                                          m_plugin.context, m_plugin.name);
+                ++count;
+            }
+        }
+        if (count == 0) {
+            cerr << "[PluginLibrary] " << m_plugin.name << " asked for no commands\n";
+        }
+        return count;
+    }
+
+private:
+    string     m_path;
+    void*      m_handle      { nullptr };
+    msp_plugin m_plugin      {};
+    bool       m_initialized { false }; // shutdown() is owed
+
+    void unload() {
+        if (m_initialized && m_plugin.shutdown != nullptr) {
+            m_plugin.shutdown(m_plugin.context);
+        }
+        m_initialized = false;
+        if (m_handle != nullptr) {
+            dlclose(m_handle);
+            m_handle = nullptr;
+        }
+    }
+
+    /**
+     * Constructor failure: the destructor won't run, clean up here.
+     */
+    [[noreturn]] void fail(const string& reason) {
+        unload();
+        MSP_THROW(runtime_error, "Plugin " + m_path + ": " + reason);
+    }
+};
+
+/******************************************************************************
+ *                        Pipelined Message Handler
+ *
+ * Optional parse/execute split for the two-core SoCs. The receive + parse
+ * thread copies every validated frame into a lock-free SPSC ring and goes
+ * straight back to the socket; an executor thread drains the ring into the
+ * wrapped handler, so a slow executor no longer delays reading. The executor
+ * thread sleeps on an eventfd when the ring is empty and the parse thread only
+ * signals it when it is actually asleep, so a busy stream costs no syscalls.
+ * Slots hold the raw frame (the payload is a view into it) sized for MSPv1
+ * payloads to keep the ring small; a full ring or a larger (jumbo / MSPv2)
+ * frame drops the frame and counts it.
+ ******************************************************************************/
+struct PipelineStats {
+    StatCounter queued;   // frames handed to the executor thread
+    StatCounter dropped;  // frames lost because the ring was full
+    StatCounter oversize; // frames lost because the payload exceeds a slot
+};
+
+/**
+ * Pin the calling thread to 'cpu' (-1 = leave as is) and switch it to
+ * SCHED_FIFO at 'priority' (0 = leave as is). Failures are reported but not
+ * fatal, the pipeline still works without them.
+ */
+void configureCurrentThread(const char* name, int cpu, int priority) {
+    if (cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            cerr << "[Pipeline] Failed to pin " << name << " thread to CPU " << cpu
+                 << ": " << strerror(err) << "\n";
+        }
+    }
+    if (priority > 0) {
+        sched_param param {};
+        param.sched_priority = priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) {
+            cerr << "[Pipeline] Failed to set SCHED_FIFO " << priority << " for " << name
+                 << " thread: " << strerror(err) << "\n";
+        }
+    }
+}
+
+class PipelinedMessageHandler : public IMspMessageHandler {
+public:
+    explicit PipelinedMessageHandler(IMspMessageHandler& target)
+        : m_target(target)
+    {
+        m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (m_wakeFd < 0) {
+            perror("Failed to create eventfd");
+            MSP_THROW(runtime_error, "eventfd creation failed");
+        }
+    }
+
+    ~PipelinedMessageHandler() override {
+        stop();
+        close(m_wakeFd);
+    }
+
+    /**
+     * Call 'callback' on the executor thread every intervalMs milliseconds.
+     * Executors that buffer output (alink batching) must be flushed from the
+     * thread that runs them. Call before start().
+     */
+    void addPeriodic(int intervalMs, function<void()> callback) {
+        m_periodic.push_back({ intervalMs * 1000000LL, 0, move(callback) });
+    }
+
+    /**
+     * Start the executor thread, see configureCurrentThread() for cpu and priority.
+     */
+    void start(int cpu, int priority) {
+        if (!m_thread.joinable()) {
+            m_running.store(true, memory_order_relaxed);
+            m_thread = thread(&PipelinedMessageHandler::executorLoop, this, cpu, priority);
+        }
+    }
+
+    /**
+     * Execute everything still queued and stop the executor thread.
+     */
+    void stop() {
+        if (m_thread.joinable()) {
+            m_running.store(false, memory_order_relaxed);
+            wake();
+            m_thread.join();
+        }
+    }
+
+    /**
+     * Parse thread: queue a copy of the frame.
+     */
+    void onMspMessage(const MspMessage& msg) override {
+        if (msg.frameSize > QueuedFrame::SLOT_SIZE) {
+            m_stats.oversize.add();
+            return;
+        }
+        QueuedFrame* frame = m_ring.claim();
+        if (frame == nullptr) {
+            m_stats.dropped.add();
+            return;
+        }
+        frame->message       = msg;
+        frame->payloadOffset = static_cast<uint16_t>(msg.payload - msg.frame);
+        memcpy(frame->frame, msg.frame, msg.frameSize);
+        m_ring.publish();
+        m_stats.queued.add();
+
+        // Pairs with the fence in executorLoop(): either we see the executor
+        // asleep, or it sees the frame we just published.
+        atomic_thread_fence(memory_order_seq_cst);
+        if (m_sleeping.load(memory_order_relaxed)) {
+            wake();
+        }
+    }
+
+    const MspCommandMask* interestMask() const override {
+        return m_target.interestMask();
+    }
+
+    const PipelineStats& stats() const {
+        return m_stats;
+    }
+
+private:
+    struct QueuedFrame {
+        static const size_t SLOT_SIZE = MSP_MAX_PAYLOAD_SIZE + 16; // + header and checksum
+
+        MspMessage message;
+        uint16_t   payloadOffset;
+        uint8_t    frame[SLOT_SIZE];
+    };
+
+    struct Periodic {
+        int64_t          intervalNs;
+        int64_t          dueNs;
+        function<void()> callback;
+    };
+
+    IMspMessageHandler&                      m_target;
+    SpscRing<QueuedFrame, FRAME_QUEUE_SIZE>  m_ring;
+    PipelineStats                            m_stats;
+    vector<Periodic>                         m_periodic;
+    thread                                   m_thread;
+    atomic<bool>                             m_running  { false };
+    atomic<bool>                             m_sleeping { false };
+    int                                      m_wakeFd   { -1 };
+
+    void wake() {
+        uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("Failed to wake executor thread");
+        }
+    }
+
+    void executorLoop(int cpu, int priority) {
+        configureCurrentThread("executor", cpu, priority);
+
+        int64_t startNs = monotonicNs();
+        for (auto& periodic : m_periodic) {
+            periodic.dueNs = startNs + periodic.intervalNs;
+        }
+
+        while (true) {
+            bool running = m_running.load(memory_order_relaxed);
+            drain();
+            int timeoutMs = runPeriodic();
+            if (!running) {
+                return; // everything queued before stop() has been executed
+            }
+
+            m_sleeping.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (m_ring.peek() == nullptr && m_running.load(memory_order_relaxed)) {
+                pollfd wakeup { m_wakeFd, POLLIN, 0 };
+                if (poll(&wakeup, 1, timeoutMs) > 0) {
+                    uint64_t count = 0;
+                    if (read(m_wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                        perror("Failed to read executor wakeup");
+                    }
+                }
+            }
+            m_sleeping.store(false, memory_order_relaxed);
+        }
+    }
+
+    void drain() {
+        while (QueuedFrame* frame = m_ring.peek()) {
+            frame->message.frame   = frame->frame;
+            frame->message.payload = frame->frame + frame->payloadOffset;
+            m_target.onMspMessage(frame->message);
+            m_ring.release();
+        }
+    }
+
+    /**
+     * Run the callbacks that are due. Returns the poll() timeout until the
+     * next one, -1 if there are none.
+     */
+    int runPeriodic() {
+        if (m_periodic.empty()) {
+            return -1;
+        }
+        int64_t nowNs  = monotonicNs();
+        int64_t nextNs = INT64_MAX;
+        for (auto& periodic : m_periodic) {
+            if (nowNs >= periodic.dueNs) {
+                periodic.callback();
+                periodic.dueNs = nowNs + periodic.intervalNs;
+            }
+            nextNs = min(nextNs, periodic.dueNs);
+        }
+        return static_cast<int>((nextNs - nowNs + 999999) / 1000000);
+    }
+};
+
+/******************************************************************************
+ *                         Input Source Interfaces
+ *
+ * Single Responsibility: Each concrete input source (UDP, file) handles how
+ * data is read, while the rest of the code simply calls receiveData().
+ * 
+ * For Liskov Substitution: UdpInputSource and FileInputSource must behave
+ * consistently as IInputSource.
+ ******************************************************************************/
+class IInputSource {
+public:
+    virtual ~IInputSource() = default;
+    virtual ssize_t receiveData(uint8_t* buffer, size_t bufferSize) = 0;
+
+    /**
+     * Receive the next chunk of input and point 'data' at it.
+     * Sources that keep their own buffers (e.g. batched UDP) return a view
+     * into them; the default reads into the caller-provided fallback buffer.
+     * The view stays valid until the next call.
+     */
+    virtual ssize_t receiveView(const uint8_t*& data, uint8_t* fallback, size_t fallbackSize) {
+        data = fallback;
+        return receiveData(fallback, fallbackSize);
+    }
+
+    /**
+     * File descriptor the EventLoop can wait on, or -1 if the source can't
+     * be polled (it is then read in a simple blocking loop).
+     */
+    virtual int fd() const { return -1; }
+
+    /**
+     * Input the last chunk came from when replaying a capture of several
+     * inputs (its record's sourceId), 0 for everything else.
+     */
+    virtual uint16_t chunkSource() const { return 0; }
+
+    /**
+     * Send bytes back to the flight controller (MSP requests). Returns the
+     * number of bytes sent, 0 if there is nobody to send to yet, -1 if the
+     * source can't send.
+     */
+    virtual ssize_t sendData(const uint8_t*, size_t) {
+        errno = ENOTSUP;
+        return -1;
+    }
+};
+
+/**
+ * UDP input source
+ *
+ * With batchSize > 1 datagrams are received with recvmmsg() into a
+ * preallocated ring of buffers, and handed out one by one before the next
+ * syscall. timeoutMs bounds how long a receive waits for the first datagram
+ * (0 = block forever); on timeout receiveData() returns 0. sendData() answers
+ * the sender of the latest datagram.
+ */
+class UdpInputSource : public IInputSource {
+public:
+    explicit UdpInputSource(int port, size_t batchSize = 1, int timeoutMs = 0)
+        : m_batchSize(batchSize > 0 ? batchSize : 1)
+    {
+        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_socket < 0) {
+            perror("Failed to create UDP socket");
+            MSP_THROW(runtime_error, "Socket creation failed");
+        }
+
+        sockaddr_in serverAddr{};
+        serverAddr.sin_family      = AF_INET;
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+        serverAddr.sin_port        = htons(port);
+
+        if (bind(m_socket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) {
+            perror("Failed to bind UDP socket");
+            close(m_socket);
+            MSP_THROW(runtime_error, "Socket binding failed");
+        }
+
+        if (timeoutMs > 0) {
+            timeval tv {};
+            tv.tv_sec  = timeoutMs / 1000;
+            tv.tv_usec = (timeoutMs % 1000) * 1000;
+            if (setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+                perror("Failed to set UDP receive timeout");
+            }
+        }
+
+        if (m_batchSize > 1) {
+            m_ring.resize(m_batchSize * UDP_DATAGRAM_SIZE);
+            m_iovecs.resize(m_batchSize);
+            m_msgs.resize(m_batchSize);
+            for (size_t i = 0; i < m_batchSize; ++i) {
+                m_iovecs[i].iov_base = &m_ring[i * UDP_DATAGRAM_SIZE];
+                m_iovecs[i].iov_len  = UDP_DATAGRAM_SIZE;
+                memset(&m_msgs[i], 0, sizeof(m_msgs[i]));
+                m_msgs[i].msg_hdr.msg_iov    = &m_iovecs[i];
+                m_msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            m_names.resize(m_batchSize);
+        }
+
+        cout << "[UdpInputSource] Listening on UDP port " << port;
+        if (m_batchSize > 1) {
+            cout << " (batch " << m_batchSize << ")";
+        }
+        cout << "...\n";
+    }
+
+    ~UdpInputSource() override {
+        if (m_socket >= 0) {
+            close(m_socket);
+        }
+    }
+
+    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
+        if (m_batchSize > 1) {
+            const uint8_t* data = nullptr;
+            ssize_t len = receiveView(data, buffer, bufferSize);
+            if (len > 0 && data != buffer) {
+                len = min<ssize_t>(len, bufferSize);
+                memcpy(buffer, data, len);
+            }
+            return len;
+        }
+
+        sockaddr_in clientAddr{};
+        socklen_t clientLen = sizeof(clientAddr);
+
+        ssize_t bytesRead = recvfrom(
+            m_socket,
+            buffer,
+            bufferSize,
+            0,
+            reinterpret_cast<sockaddr*>(&clientAddr),
+            &clientLen
+        );
+
+        if (bytesRead < 0) {
+            return receiveError();
+        }
+
+        rememberPeer(clientAddr);
+        return bytesRead;
+    }
+
+    int fd() const override {
+        return m_socket;
+    }
+
+    ssize_t sendData(const uint8_t* data, size_t len) override {
+        uint64_t peer = m_peer.load(memory_order_relaxed);
+        if (peer == 0) {
+            return 0;
+        }
+        sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = static_cast<uint32_t>(peer >> 16);
+        addr.sin_port        = static_cast<uint16_t>(peer);
+        return sendto(m_socket, data, len, 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    ssize_t receiveView(const uint8_t*& data, uint8_t* fallback, size_t fallbackSize) override {
+        if (m_batchSize == 1) {
+            return IInputSource::receiveView(data, fallback, fallbackSize);
+        }
+
+        if (m_next == m_count) {
+            // Ring drained: wait for at least one datagram, take whatever else is queued
+            for (size_t i = 0; i < m_batchSize; ++i) {
+                m_msgs[i].msg_hdr.msg_name    = &m_names[i];
+                m_msgs[i].msg_hdr.msg_namelen = sizeof(m_names[i]);
+            }
+            int received = recvmmsg(m_socket, m_msgs.data(), m_batchSize, MSG_WAITFORONE, nullptr);
+            if (received < 0) {
+                m_next = m_count = 0;
+                return receiveError();
+            }
+            m_next  = 0;
+            m_count = static_cast<size_t>(received);
+            if (m_count == 0) {
+                return 0;
+            }
+            rememberPeer(m_names[m_count - 1]);
+        }
+
+        size_t slot = m_next++;
+        data = &m_ring[slot * UDP_DATAGRAM_SIZE];
+        return m_msgs[slot].msg_len;
+    }
+
+private:
+    static const size_t UDP_DATAGRAM_SIZE = FRAME_BUFFER_SIZE;
+
+    int             m_socket    { -1 };
+    size_t          m_batchSize { 1 };
+    size_t          m_next      { 0 };
+    size_t          m_count     { 0 };
+    vector<uint8_t> m_ring;
+    vector<iovec>   m_iovecs;
+    vector<mmsghdr> m_msgs;
+    vector<sockaddr_in> m_names;
+    // Latest sender as address << 16 | port (network order), 0 = none yet;
+    // read by sendData(), which may run on the executor thread
+    atomic<uint64_t> m_peer { 0 };
+
+    void rememberPeer(const sockaddr_in& addr) {
+        m_peer.store(static_cast<uint64_t>(addr.sin_addr.s_addr) << 16 | addr.sin_port,
+                     memory_order_relaxed);
+    }
+
+    /**
+     * Timeouts and interrupted waits are not errors: report "no data".
+     */
+    static ssize_t receiveError() {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        perror("Error receiving UDP data");
+        return -1;
+    }
+};
+
+/**
+ * Serial (UART) input source, reading straight from the flight controller.
+ *
+ * The port is put in raw 8N1 mode without flow control, VMIN = minBytes and
+ * VTIME = 0. With VTIME = 0 poll()/epoll report the port readable only once
+ * VMIN bytes are queued, so anything above 1 holds the tail of a frame (its
+ * checksum included) until the next frame arrives; the default is 1, and a
+ * read still drains everything the driver has queued. lowLatency sets
+ * ASYNC_LOW_LATENCY where the driver supports it, so received bytes are
+ * pushed to the tty layer immediately rather than on the next flip timer.
+ */
+class SerialInputSource : public IInputSource {
+public:
+    SerialInputSource(const string& device, int baudRate, int minBytes, bool lowLatency) {
+        speed_t speed = toSpeed(baudRate);
+        if (speed == B0) {
+            MSP_THROW(invalid_argument, "Unsupported baud rate: " + to_string(baudRate));
+        }
+
+        m_fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (m_fd < 0) {
+            perror("Failed to open serial port");
+            MSP_THROW(runtime_error, "Failed to open serial port: " + device);
+        }
+
+        termios tio {};
+        if (tcgetattr(m_fd, &tio) < 0) {
+            perror("Failed to read serial port settings");
+            close(m_fd);
+            MSP_THROW(runtime_error, "tcgetattr failed");
+        }
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+        tio.c_cc[VMIN]  = static_cast<cc_t>(minBytes);
+        tio.c_cc[VTIME] = 0;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        if (tcsetattr(m_fd, TCSANOW, &tio) < 0) {
+            perror("Failed to configure serial port");
+            close(m_fd);
+            MSP_THROW(runtime_error, "tcsetattr failed");
+        }
+        tcflush(m_fd, TCIFLUSH); // drop whatever was queued before we took over
+
+        if (lowLatency) {
+            serial_struct serial {};
+            if (ioctl(m_fd, TIOCGSERIAL, &serial) < 0 ||
+                (serial.flags |= ASYNC_LOW_LATENCY, ioctl(m_fd, TIOCSSERIAL, &serial) < 0))
+            {
+                perror("[SerialInputSource] ASYNC_LOW_LATENCY not supported");
+            }
+        }
+
+        cout << "[SerialInputSource] Reading from " << device << " at " << baudRate << " baud...\n";
+    }
+
+    ~SerialInputSource() override {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
+        ssize_t bytesRead = read(m_fd, buffer, bufferSize);
+        if (bytesRead < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            perror("Error reading serial port");
+            return -1;
+        }
+        return bytesRead;
+    }
+
+    int fd() const override {
+        return m_fd;
+    }
+
+    ssize_t sendData(const uint8_t* data, size_t len) override {
+        return write(m_fd, data, len);
+    }
+
+private:
+    int m_fd { -1 };
+
+    static speed_t toSpeed(int baudRate) {
+        switch (baudRate) {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 500000:  return B500000;
+        case 921600:  return B921600;
+        case 1000000: return B1000000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        default:      return B0;
+        }
+    }
+};
+
+/**
+ * File input source
+ */
+class FileInputSource : public IInputSource {
+public:
+    explicit FileInputSource(const string& filePath) {
+        m_fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            MSP_THROW(runtime_error, "Failed to open file: " + filePath);
+        }
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        cout << "[FileInputSource] Reading from file: " << filePath << "...\n";
+    }
+
+    ~FileInputSource() override {
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
+        ssize_t bytesRead = 0;
+        do {
+            bytesRead = read(m_fd, buffer, bufferSize);
+        } while (bytesRead < 0 && errno == EINTR);
+        if (bytesRead <= 0) {
+            if (bytesRead < 0) {
+                perror("Error reading file");
+            }
+            return -1; // signals EOF or error
+        }
+        return bytesRead;
+    }
+
+private:
+    int m_fd { -1 };
+};
+
+/******************************************************************************
+ *                         Capture Format & Recording
+ *
+ * Append-only binary capture of everything an input source receives:
+ *
+ *   CaptureFileHeader                      once, at offset 0
+ *   { CaptureRecordHeader, data[length] }  one record per received chunk
+ *
+ * Timestamps are CLOCK_MONOTONIC nanoseconds, fields are little endian (as
+ * are all supported targets). A chunk is whatever a single receive returned:
+ * a UDP datagram, a serial read, ...
+ ******************************************************************************/
+static const char     CAPTURE_MAGIC[8] = { 'M', 'S', 'P', 'C', 'A', 'P', '0', '1' };
+static const uint32_t CAPTURE_VERSION  = 1;
+
+struct CaptureFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} __attribute__((packed));
+
+struct CaptureRecordHeader {
+    uint64_t timestampNs;
+    uint16_t sourceId;
+    uint16_t length;
+} __attribute__((packed));
+
+struct CaptureStats {
+    StatCounter records; // records written
+    StatCounter lost;    // records dropped by a failed write
+};
+
+/**
+ * Buffered capture writer.
+ *
+ * Records are staged in memory and written with a single writev() when the
+ * stage is full (a record that doesn't fit goes out in the same call), or on
+ * flush(). With fsyncEvery > 0 the file is fsync()ed after that many writes.
+ *
+ * An existing capture of the same version is appended to; any other
+ * non-empty file is refused. A failed write (disk full) is cut back to the
+ * last complete write, so the file stays readable, and its records are
+ * counted as lost.
+ */
+class CaptureWriter {
+public:
+    CaptureWriter(const string& filePath, int fsyncEvery)
+        : m_fsyncEvery(fsyncEvery)
+        , m_stage(CAPTURE_STAGE_SIZE)
+    {
+        m_fd = open(filePath.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            perror("Failed to open capture file");
+            MSP_THROW(runtime_error, "Failed to open capture file: " + filePath);
+        }
+
+        struct stat st {};
+        if (fstat(m_fd, &st) < 0) {
+            perror("Failed to stat capture file");
+            close(m_fd);
+            MSP_THROW(runtime_error, "Failed to stat capture file: " + filePath);
+        }
+        m_fileSize = static_cast<uint64_t>(st.st_size);
+
+        CaptureFileHeader header {};
+        if (m_fileSize == 0) {
+            stageFileHeader();
+        }
+        else if (pread(m_fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+                 memcmp(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0 ||
+                 header.version != CAPTURE_VERSION)
+        {
+            close(m_fd);
+            MSP_THROW(runtime_error, "Not a version " + to_string(CAPTURE_VERSION) +
+                                     " capture, refusing to append: " + filePath);
+        }
+        cout << "[CaptureWriter] Recording to " << filePath << "\n";
+    }
+
+    ~CaptureWriter() {
+        flush();
+        if (m_fd >= 0) {
+            if (m_fsyncEvery > 0) {
+                fsync(m_fd);
+            }
+            close(m_fd);
+        }
+    }
+
+    void record(uint16_t sourceId, const uint8_t* data, size_t len) {
+        // Records are limited to 64 KiB, the largest UDP datagram
+        len = min<size_t>(len, UINT16_MAX);
+
+        CaptureRecordHeader header {};
+        header.timestampNs = static_cast<uint64_t>(monotonicNs());
+        header.sourceId    = sourceId;
+        header.length      = static_cast<uint16_t>(len);
+
+        ++m_stagedRecords;
+        if (m_used + sizeof(header) + len <= m_stage.size()) {
+            append(&header, sizeof(header));
+            append(data, len);
+            return;
+        }
+
+        // Stage full: write it out together with this record
+        iovec iov[3] {};
+        iov[0].iov_base = m_stage.data();
+        iov[0].iov_len  = m_used;
+        iov[1].iov_base = &header;
+        iov[1].iov_len  = sizeof(header);
+        iov[2].iov_base = const_cast<uint8_t*>(data);
+        iov[2].iov_len  = len;
+        writeOut(iov, 3);
+    }
+
+    void flush() {
+        if (m_used > 0) {
+            iovec iov {};
+            iov.iov_base = m_stage.data();
+            iov.iov_len  = m_used;
+            writeOut(&iov, 1);
+        }
+    }
+
+    const CaptureStats& stats() const {
+        return m_stats;
+    }
+
+private:
+    static const size_t CAPTURE_STAGE_SIZE = 64 * 1024;
+
+    int             m_fd            { -1 };
+    int             m_fsyncEvery    { 0 };
+    int             m_writes        { 0 };
+    vector<uint8_t> m_stage;
+    size_t          m_used          { 0 };
+    size_t          m_stagedRecords { 0 };
+    uint64_t        m_fileSize      { 0 }; // bytes of complete writes
+    CaptureStats    m_stats;
+
+    void append(const void* data, size_t len) {
+        memcpy(m_stage.data() + m_used, data, len);
+        m_used += len;
+    }
+
+    void stageFileHeader() {
+        CaptureFileHeader header {};
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        header.version = CAPTURE_VERSION;
+        append(&header, sizeof(header));
+    }
+
+    void writeOut(iovec* iov, int count) {
+        size_t total = 0;
+        for (int i = 0; i < count; ++i) {
+            total += iov[i].iov_len;
+        }
+
+        // writev() may stop short (disk full, signal): continue after what it wrote
+        size_t written = 0;
+        while (written < total) {
+            ssize_t result = writev(m_fd, iov, count);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                perror("Failed to write capture file");
+                if (written > 0 && ftruncate(m_fd, static_cast<off_t>(m_fileSize)) < 0) {
+                    perror("Failed to cut back capture file");
+                }
+                break;
+            }
+            written += static_cast<size_t>(result);
+            for (size_t skip = static_cast<size_t>(result); skip > 0; ) {
+                size_t step = min(skip, iov->iov_len);
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + step;
+                iov->iov_len -= step;
+                skip         -= step;
+                if (iov->iov_len == 0) {
+                    ++iov;
+                    --count;
+                }
+            }
+        }
+        if (written == total) {
+            m_fileSize += total;
+            m_stats.records.add(m_stagedRecords);
+        } else {
+            m_stats.lost.add(m_stagedRecords);
+        }
+        m_stagedRecords = 0;
+        m_used = 0;
+        if (m_fileSize == 0) {
+            stageFileHeader(); // lost with the failed write, retry it with the next one
+        }
+        if (m_fsyncEvery > 0 && ++m_writes >= m_fsyncEvery) {
+            fdatasync(m_fd);
+            m_writes = 0;
+        }
+    }
+};
+
+/**
+ * Input source decorator that records every received chunk.
+ */
+class CaptureTeeInputSource : public IInputSource {
+public:
+    CaptureTeeInputSource(unique_ptr<IInputSource> source, CaptureWriter& writer, uint16_t sourceId)
+        : m_source(move(source))
+        , m_writer(writer)
+        , m_sourceId(sourceId)
+    {
+    }
+
+    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
+        ssize_t len = m_source->receiveData(buffer, bufferSize);
+        if (len > 0) {
+            m_writer.record(m_sourceId, buffer, static_cast<size_t>(len));
+        }
+        return len;
+    }
+
+    ssize_t receiveView(const uint8_t*& data, uint8_t* fallback, size_t fallbackSize) override {
+        ssize_t len = m_source->receiveView(data, fallback, fallbackSize);
+        if (len > 0) {
+            m_writer.record(m_sourceId, data, static_cast<size_t>(len));
+        }
+        return len;
+    }
+
+    int fd() const override {
+        return m_source->fd();
+    }
+
+    ssize_t sendData(const uint8_t* data, size_t len) override {
+        return m_source->sendData(data, len);
+    }
+
+private:
+    unique_ptr<IInputSource> m_source;
+    CaptureWriter&           m_writer;
+    uint16_t                 m_sourceId;
+};
+
+/**
+ * Memory-mapped replay source for raw files and captures.
+ *
+ * The file is mapped in windows of REPLAY_WINDOW_SIZE bytes (so multi-gigabyte
+ * files also work on 32-bit targets) with MADV_SEQUENTIAL, and data is handed
+ * to the parser as views into the mapping.
+ *
+ * Raw files are returned a window at a time; with bytesPerSecond > 0 they are
+ * paced to that rate instead of running as fast as possible. Captures (see
+ * CaptureWriter) are returned one record at a time, optionally only those of
+ * one source; with realtime set they are replayed at their original timing.
+ */
+class ReplayInputSource : public IInputSource {
+public:
+    ReplayInputSource(const string& filePath, uint64_t bytesPerSecond, bool realtime, int sourceFilter)
+        : m_bytesPerSecond(bytesPerSecond)
+        , m_realtime(realtime)
+        , m_sourceFilter(sourceFilter)
+    {
+        m_fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            MSP_THROW(runtime_error, "Failed to open file: " + filePath);
+        }
+        struct stat st {};
+        if (fstat(m_fd, &st) < 0) {
+            close(m_fd);
+            MSP_THROW(runtime_error, "Failed to stat file: " + filePath);
+        }
+        m_fileSize = static_cast<uint64_t>(st.st_size);
+
+        if (const uint8_t* header = view(0, sizeof(CaptureFileHeader))) {
+            m_capture = memcmp(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0;
+        }
+        if (m_capture) {
+            m_offset = sizeof(CaptureFileHeader);
+        }
+
+        cout << "[ReplayInputSource] Replaying " << (m_capture ? "capture " : "") << filePath
+             << " (" << m_fileSize << " bytes)...\n";
+    }
+
+    ~ReplayInputSource() override {
+        unmapWindow();
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
+        const uint8_t* data = nullptr;
+        ssize_t len = receiveView(data, buffer, bufferSize);
+        if (len > static_cast<ssize_t>(bufferSize)) {
+            if (!m_capture) {
+                m_offset -= len - bufferSize; // give back what didn't fit
+            }
+            len = bufferSize;
+        }
+        if (len > 0) {
+            memcpy(buffer, data, len);
+        }
+        return len;
+    }
+
+    ssize_t receiveView(const uint8_t*& data, uint8_t*, size_t) override {
+        return m_capture ? nextRecord(data) : nextRawChunk(data);
+    }
+
+    uint16_t chunkSource() const override {
+        return m_chunkSource;
+    }
+
+private:
+    int       m_fd         { -1 };
+    uint64_t  m_fileSize   { 0 };
+    uint64_t  m_offset     { 0 };       // file offset of the next byte to hand out
+    uint8_t*  m_window     { nullptr };
+    uint64_t  m_windowBase { 0 };       // file offset of m_window
+    size_t    m_windowSize { 0 };
+
+    uint64_t  m_bytesPerSecond { 0 };
+    bool      m_realtime       { false };
+    int       m_sourceFilter   { -1 };
+    bool      m_capture        { false };
+    int64_t   m_startNs        { -1 };
+    uint64_t  m_released       { 0 };   // bytes handed out while pacing
+    int64_t   m_firstRecordNs  { -1 };
+    uint16_t  m_chunkSource    { 0 };   // sourceId of the last record
+
+    ssize_t nextRawChunk(const uint8_t*& data) {
+        if (m_offset >= m_fileSize) {
+            return -1; // end of file
+        }
+        size_t len = static_cast<size_t>(min<uint64_t>(REPLAY_WINDOW_SIZE, m_fileSize - m_offset));
+        if (m_bytesPerSecond > 0) {
+            len = min<size_t>(len, pacedBudget());
+        }
+        data = view(m_offset, 1);
+        if (data == nullptr) {
+            return -1;
+        }
+        len       = static_cast<size_t>(min<uint64_t>(len, m_windowBase + m_windowSize - m_offset));
+        m_offset += len;
+        return static_cast<ssize_t>(len);
+    }
+
+    ssize_t nextRecord(const uint8_t*& data) {
+        while (true) {
+            const uint8_t* raw = view(m_offset, sizeof(CaptureRecordHeader));
+            if (raw == nullptr) {
+                return -1; // end of capture (or truncated last record)
+            }
+            CaptureRecordHeader header;
+            memcpy(&header, raw, sizeof(header));
+
+            data = view(m_offset + sizeof(header), header.length);
+            if (data == nullptr) {
+                return -1;
+            }
+            m_offset += sizeof(header) + header.length;
+
+            if (m_sourceFilter >= 0 && header.sourceId != m_sourceFilter) {
+                continue;
+            }
+            if (m_realtime) {
+                waitForTimestamp(static_cast<int64_t>(header.timestampNs));
+            }
+            m_chunkSource = header.sourceId;
+            return header.length;
+        }
+    }
+
+    /**
+     * Pointer to 'len' bytes at file offset 'offset', remapping the window
+     * if needed. Returns nullptr if the range is past the end of the file.
+     */
+    const uint8_t* view(uint64_t offset, size_t len) {
+        if (offset + len > m_fileSize) {
+            return nullptr;
+        }
+        if (m_window == nullptr || offset < m_windowBase ||
+            offset + len > m_windowBase + m_windowSize)
+        {
+            if (!mapWindow(offset, len)) {
+                return nullptr;
+            }
+        }
+        return m_window + (offset - m_windowBase);
+    }
+
+    bool mapWindow(uint64_t offset, size_t minLen) {
+        unmapWindow();
+
+        uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t base = offset - offset % page;
+        uint64_t size = max<uint64_t>(REPLAY_WINDOW_SIZE, offset - base + minLen);
+        size          = min<uint64_t>(size, m_fileSize - base);
+
+        void* addr = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(base));
+        if (addr == MAP_FAILED) {
+            perror("Failed to map replay file");
+            return false;
+        }
+        madvise(addr, static_cast<size_t>(size), MADV_SEQUENTIAL);
+        m_window     = static_cast<uint8_t*>(addr);
+        m_windowBase = base;
+        m_windowSize = static_cast<size_t>(size);
+        return true;
+    }
+
+    void unmapWindow() {
+        if (m_window != nullptr) {
+            munmap(m_window, m_windowSize);
+            m_window     = nullptr;
+            m_windowSize = 0;
+        }
+    }
+
+    /**
+     * Bytes that may be released now to stay on the configured rate.
+     * Sleeps until at least one byte is due.
+     */
+    size_t pacedBudget() {
+        int64_t now = monotonicNs();
+        if (m_startNs < 0) {
+            m_startNs = now;
+        }
+        while (true) {
+            uint64_t due = static_cast<uint64_t>(now - m_startNs) * m_bytesPerSecond / 1000000000ULL;
+            if (due > m_released) {
+                size_t budget = static_cast<size_t>(min<uint64_t>(due - m_released, FRAME_BUFFER_SIZE));
+                m_released   += budget;
+                return budget;
+            }
+            uint64_t waitNs = (m_released + 1 - due) * 1000000000ULL / m_bytesPerSecond;
+            sleepNs(static_cast<int64_t>(max<uint64_t>(waitNs, 1000)));
+            now = monotonicNs();
+        }
+    }
+
+    /**
+     * Sleep until a record captured at 'timestampNs' is due, relative to the
+     * first replayed record.
+     */
+    void waitForTimestamp(int64_t timestampNs) {
+        int64_t now = monotonicNs();
+        if (m_firstRecordNs < 0) {
+            m_firstRecordNs = timestampNs;
+            m_startNs       = now;
+            return;
+        }
+        int64_t waitNs = (timestampNs - m_firstRecordNs) - (now - m_startNs);
+        if (waitNs > 0) {
+            sleepNs(waitNs);
+        }
+    }
+};
+
+/******************************************************************************
+ *                          MSP Request Scheduler
+ *
+ * Polls the flight controller instead of relying on some other process to:
+ * sends "$M<" requests for a set of commands at per-command rates through
+ * the primary input source, and matches the "$M>" responses coming back
+ * through the dispatcher.
+ *
+ *   --poll 108:50+105:20+101:5+102:1     command:hz, '+' separated
+ *
+ * Requests are pipelined: up to 'inflight' are outstanding at once, and as
+ * the FC answers in order each response is matched to the oldest
+ * outstanding request of its command, yielding a round-trip sample.
+ *
+ * Rates adapt to what the link carries (AIMD on the polling intervals): a
+ * request unanswered after the timeout doubles every interval; a request
+ * that is due while the pipeline is still full, or a smoothed RTT far above
+ * the minimum seen (responses queueing somewhere), stretches them by a
+ * quarter. Back-offs happen at most once per BACKOFF_HOLDOFF_NS, and every
+ * answered request shrinks the stretch by 1/32 again until the configured
+ * rates are reached.
+ *
+ * Single-threaded: tick() and onResponse() run on the executor thread (a
+ * timer, or the pipeline's periodic callbacks, and a dispatcher executor).
+ ******************************************************************************/
+struct PollSpec {
+    MspCommand command;
+    int        rateHz;
+};
+
+struct PollStats {
+    StatCounter requests;   // requests sent
+    StatCounter responses;  // responses matched to a request
+    StatCounter timeouts;   // requests given up on
+    StatCounter sendErrors; // failed sendData() calls
+    StatCounter stretch;    // polling interval scale, STRETCH_ONE = configured rates
+};
+
+struct PollCommandStats {
+    StatCounter requests;
+    StatCounter responses;
+    StatCounter rttUs;    // smoothed round-trip time
+    StatCounter minRttUs;
+    StatCounter maxRttUs;
+};
+
+class MspRequestScheduler {
+public:
+    static const size_t   MAX_INFLIGHT = 16;
+    static const uint32_t STRETCH_ONE  = 256;
+
+    MspRequestScheduler(IInputSource& link, size_t maxInflight, int timeoutMs)
+        : m_link(link)
+        , m_maxInflight(maxInflight == 0 ? 1 : maxInflight > MAX_INFLIGHT ? MAX_INFLIGHT : maxInflight)
+        , m_timeoutNs(timeoutMs * 1000000LL)
+    {
+        fill(begin(m_index), end(m_index), -1);
+        m_stats.stretch.set(m_stretch);
+    }
+
+    void addCommand(MspCommand command, int rateHz) {
+        uint16_t id = static_cast<uint16_t>(command);
+        if (id >= MSP_COMMAND_COUNT || rateHz <= 0) {
+            MSP_THROW(out_of_range, "Invalid poll command " + to_string(id) + " at " + to_string(rateHz) + " Hz");
+        }
+        if (m_index[id] < 0) {
+            m_index[id] = static_cast<int16_t>(m_polls.size());
+            m_polls.push_back(make_unique<Poll>());
+            m_commands.set(command);
+        }
+        Poll& poll          = *m_polls[m_index[id]];
+        poll.command        = command;
+        poll.baseIntervalNs = 1000000000LL / rateHz;
+    }
+
+    const MspCommandMask& commands() const {
+        return m_commands;
+    }
+
+    /**
+     * Expire overdue requests and send the ones that are due, all in one
+     * sendData() call.
+     */
+    void tick(int64_t nowNs = monotonicNs()) {
+        for (auto& poll : m_polls) {
+            while (poll->outstanding > 0 && nowNs - poll->sentNs[poll->oldest] > m_timeoutNs) {
+                poll->oldest = (poll->oldest + 1) % MAX_INFLIGHT;
+                --poll->outstanding;
+                --m_inflight;
+                m_stats.timeouts.add();
+                backOff(nowNs, 2, 1);
+            }
+        }
+
+        uint8_t buffer[MAX_INFLIGHT * MSP_V1_OVERHEAD];
+        Poll*   sent[MAX_INFLIGHT];
+        size_t  count = 0;
+        for (size_t n = 0; n < m_polls.size(); ++n) {
+            // Start where the previous tick stopped, so a full pipeline can't starve anyone
+            Poll& poll = *m_polls[(m_nextPoll + n) % m_polls.size()];
+            if (nowNs < poll.dueNs) {
+                continue;
+            }
+            if (m_inflight == m_maxInflight || poll.outstanding == MAX_INFLIGHT) {
+                backOff(nowNs, 5, 4); // asking faster than the link answers
+                break;
+            }
+            encodeMspV1(&buffer[count * MSP_V1_OVERHEAD], MspMessage::Direction::OUTBOUND,
+                        static_cast<uint8_t>(poll.command), nullptr, 0);
+            poll.sentNs[(poll.oldest + poll.outstanding) % MAX_INFLIGHT] = nowNs;
+            ++poll.outstanding;
+            ++m_inflight;
+            sent[count++] = &poll;
+
+            // Keep the phase, but after a stall (or on the first request)
+            // restart from now instead of catching up with a burst
+            int64_t intervalNs = poll.baseIntervalNs * m_stretch / STRETCH_ONE;
+            poll.dueNs += intervalNs;
+            if (poll.dueNs <= nowNs) {
+                poll.dueNs = nowNs + intervalNs;
+            }
+            m_nextPoll = (m_nextPoll + n + 1) % m_polls.size();
+        }
+        if (count == 0) {
+            return;
+        }
+
+        size_t  len    = count * MSP_V1_OVERHEAD;
+        ssize_t result = m_link.sendData(buffer, len);
+        if (result != static_cast<ssize_t>(len) && result != 0) {
+            m_stats.sendErrors.add(); // 0 = no peer to send to yet, not an error
+        }
+
+        // Requests written completely reach the FC and get answered; forget
+        // the rest (a serial write can stop short), no answer is coming.
+        // Each poll is in 'sent' at most once, so it's its newest request.
+        size_t delivered = result > 0 ? static_cast<size_t>(result) / MSP_V1_OVERHEAD : 0;
+        for (size_t i = delivered; i < count; ++i) {
+            --sent[i]->outstanding;
+            --m_inflight;
+        }
+        m_stats.requests.add(delivered);
+        for (size_t i = 0; i < delivered; ++i) {
+            sent[i]->stats.requests.add();
+        }
+    }
+
+    /**
+     * A response from the FC: match it to the oldest outstanding request of
+     * its command. Responses nobody asked for (another poller) are ignored.
+     */
+    void onResponse(const MspMessage& msg, int64_t nowNs = monotonicNs()) {
+        uint16_t id = static_cast<uint16_t>(msg.cmd);
+        if (msg.direction != MspMessage::Direction::INBOUND || id >= MSP_COMMAND_COUNT || m_index[id] < 0) {
+            return;
+        }
+        Poll& poll = *m_polls[m_index[id]];
+        if (poll.outstanding == 0) {
+            return;
+        }
+        int64_t rttNs = nowNs - poll.sentNs[poll.oldest];
+        poll.oldest = (poll.oldest + 1) % MAX_INFLIGHT;
+        --poll.outstanding;
+        --m_inflight;
+
+        poll.srttNs   = (poll.srttNs == 0) ? rttNs : poll.srttNs + (rttNs - poll.srttNs) / 8;
+        poll.minRttNs = (poll.minRttNs == 0) ? rttNs : min(poll.minRttNs, rttNs);
+        m_stats.responses.add();
+        poll.stats.responses.add();
+        poll.stats.rttUs.set(poll.srttNs / 1000);
+        poll.stats.minRttUs.set(poll.minRttNs / 1000);
+        poll.stats.maxRttUs.raise(rttNs / 1000);
+
+        if (poll.srttNs > RTT_QUEUEING_FACTOR * poll.minRttNs + RTT_SLACK_NS) {
+            backOff(nowNs, 5, 4); // responses are queueing up somewhere
+        } else if (m_stretch > STRETCH_ONE) {
+            m_stretch = (m_stretch > STRETCH_ONE + STRETCH_STEP) ? m_stretch - STRETCH_STEP : STRETCH_ONE;
+            m_stats.stretch.set(m_stretch);
+        }
+    }
+
+    const PollStats& stats() const {
+        return m_stats;
+    }
+
+    size_t commandCount() const {
+        return m_polls.size();
+    }
+
+    MspCommand command(size_t i) const {
+        return m_polls[i]->command;
+    }
+
+    const PollCommandStats& commandStats(size_t i) const {
+        return m_polls[i]->stats;
+    }
+
+private:
+    static const uint32_t STRETCH_STEP        = STRETCH_ONE / 32;
+    static const uint32_t STRETCH_MAX         = STRETCH_ONE * 64;
+    static const int64_t  RTT_QUEUEING_FACTOR = 4;        // smoothed vs. minimum RTT
+    static const int64_t  RTT_SLACK_NS        = 2000000;   // jitter tolerated on top
+    static const int64_t  BACKOFF_HOLDOFF_NS  = 100000000; // one back-off per stall
+
+    struct Poll {
+        MspCommand       command        { MspCommand::UNKNOWN };
+        int64_t          baseIntervalNs { 0 };
+        int64_t          dueNs          { 0 };
+        int64_t          sentNs[MAX_INFLIGHT] {}; // FIFO of outstanding requests
+        size_t           oldest         { 0 };
+        size_t           outstanding    { 0 };
+        int64_t          srttNs         { 0 };
+        int64_t          minRttNs       { 0 };
+        PollCommandStats stats;
+    };
+
+    IInputSource&            m_link;
+    size_t                   m_maxInflight;
+    int64_t                  m_timeoutNs;
+    vector< unique_ptr<Poll> > m_polls;
+    int16_t                  m_index[MSP_COMMAND_COUNT]; // command -> m_polls, -1 = not polled
+    MspCommandMask           m_commands;
+    size_t                   m_inflight       { 0 };
+    size_t                   m_nextPoll       { 0 };
+    uint32_t                 m_stretch        { STRETCH_ONE };
+    int64_t                  m_lastBackOffNs  { INT64_MIN / 2 };
+    PollStats                m_stats;
+
+    void backOff(int64_t nowNs, uint32_t numerator, uint32_t denominator) {
+        if (nowNs - m_lastBackOffNs < BACKOFF_HOLDOFF_NS) {
+            return;
+        }
+        m_lastBackOffNs = nowNs;
+        m_stretch       = m_stretch * numerator / denominator;
+        m_stretch       = (m_stretch > STRETCH_MAX) ? STRETCH_MAX : m_stretch;
+        m_stats.stretch.set(m_stretch);
+    }
+};
+
+/**
+ * Dispatcher adapter feeding responses to the scheduler.
+ */
+class PollResponseExecutor final : public IMspCommandExecutor {
+public:
+    explicit PollResponseExecutor(MspRequestScheduler& scheduler)
+        : m_scheduler(scheduler)
+    {
+    }
+
+    void execute(const MspMessage& msg, FlightDataModel&) override {
+        m_scheduler.onResponse(msg);
+    }
+
+    const char* name() const override {
+        return "poll";
+    }
+
+private:
+    MspRequestScheduler& m_scheduler;
+};
+
+/******************************************************************************
+ *                             Runtime Options
+ *
+ * Optional "--name value" switches accepted after the positional arguments.
+ *
+ * "--config <file>" applies a file of the same options, one per line, as
+ * "name = value" (or "name value"); '#' starts a comment. Options are
+ * applied in order, so switches after --config override the file and a
+ * "source" line replaces the positional input arguments:
+ *
+ *   source         = serial:/dev/ttyS2
+ *   baud           = 115200
+ *   builtins       = 101+108+105     # STATUS, ATTITUDE, RC; no FC_VARIANT
+ *   alink-port     = 9999
+ *   forward        = 192.168.1.20:5760,format=msp,rate=20
+ *   pipeline       = 1
+ *   exec-cpu       = 1
+ *   log-level      = quiet
+ *
+ * Everything is parsed once, before anything is wired up; the hot path only
+ * sees the resulting flags and tables.
+ ******************************************************************************/
+struct RuntimeOptions {
+    string sourceSpec;           // --source type:source, instead of the positional arguments
+    int    alinkPort     { 0 };  // --alink-port, instead of the positional out_udp_port
+    bool   verbose       { true }; // --log-level verbose: per-frame console logs
+    MspCommandMask builtins;       // --builtins: built-in executors to run (see hasBuiltins)
+    bool   hasBuiltins   { false };  // false = all of them
+
+    size_t udpBatchSize  { 1 };  // datagrams per recvmmsg() call, 1 = plain recvfrom()
+    int    udpTimeoutMs  { 0 };  // receive timeout, 0 = block until data arrives
+    int    alinkRateHz   { 0 };  // max rate for unchanged alink lines, 0 = every RC frame
+    size_t alinkBatch    { 1 };  // alink lines per sendmmsg() call
+    int    alinkDeadband { -1 }; // only report link quality changes beyond this, -1 = off
+    int    alinkEstimateMs { 0 }; // --alink-estimate window, 0 = send the raw link quality
+    string alinkHost     { ALINK_DEFAULT_ADDRESS };
+
+    vector<ForwardSpec> forwards; // --forward, repeatable
+
+    vector<PollSpec> polls;                 // commands to request from the FC
+    size_t   pollInflight         { 4 };    // outstanding requests at once
+    int      pollTimeoutMs        { 200 };  // give up on a request after this long
+
+    int    serialBaud       { 115200 };
+    int    serialMinBytes   { SERIAL_MIN_READ }; // VMIN: bytes per wakeup
+    bool   serialLowLatency { true };            // ASYNC_LOW_LATENCY
+
+    uint64_t replayBytesPerSecond { 0 };     // raw replay pacing, 0 = as fast as possible
+    bool     replayRealtime       { false }; // replay captures at their original timing
+    int      replaySourceId       { -1 };    // replay only this capture source, -1 = all
+
+    string   capturePath;                    // record all inputs here if set
+    int      captureFsyncEvery    { 0 };     // fdatasync() every n capture writes, 0 = never
+
+    int      statsIntervalMs      { 0 };     // print a stats line this often, 0 = never
+    int      statsPort            { 0 };     // answer stats queries on this UDP port, 0 = off
+
+    bool     pipeline             { false }; // run executors on their own thread
+    int      parseCpu             { -1 };    // pin the receive/parse thread, -1 = any
+    int      execCpu              { -1 };    // pin the executor thread, -1 = any
+    int      parsePriority        { 0 };     // SCHED_FIFO priority, 0 = normal scheduling
+    int      execPriority         { 0 };
+
+    int      fleetWorkers         { 0 };     // fleet mode receive threads, 0 = off
+    size_t   fleetLinks           { 256 };   // senders tracked per worker
+    int      fleetIdleMs          { 10000 }; // drop senders idle this long, 0 = never
+    int      fleetCpu             { 0 };     // pin worker i to CPU fleetCpu + i, -1 = any
+
+    vector< pair<string, string> > extraInputs; // --input type:source, repeatable
+    vector< pair<string, string> > plugins;     // --plugin path[:args], repeatable
+};
+
+/**
+ * Parse a numeric option value within [minValue, maxValue].
+ */
+long parseOptionNumber(const string& name, const string& value, long minValue, long maxValue) {
+    char* end = nullptr;
+    errno = 0;
+    long number = strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0' || errno == ERANGE || number < minValue || number > maxValue) {
+        MSP_THROW(invalid_argument, "Invalid value for --" + name + ": " + value);
+    }
+    return number;
+}
+
+/**
+ * Split "a<sep>b<sep>c" into its items.
+ */
+vector<string> splitList(const string& value, char separator) {
+    vector<string> items;
+    size_t start = 0;
+    while (true) {
+        size_t end = value.find(separator, start);
+        items.push_back(value.substr(start, end == string::npos ? string::npos : end - start));
+        if (end == string::npos) {
+            return items;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * Parse a --forward value, see Forwarding Engine for the syntax.
+ */
+ForwardSpec parseForwardSpec(const string& value) {
+    ForwardSpec    spec;
+    vector<string> parts = splitList(value, ',');
+
+    size_t colon = parts[0].rfind(':');
+    if (colon == string::npos || colon == 0) {
+        MSP_THROW(invalid_argument, "Invalid value for --forward (expected host:port,...): " + value);
+    }
+    spec.host = parts[0].substr(0, colon);
+    spec.port = parseOptionNumber("forward", parts[0].substr(colon + 1), 1, 65535);
+
+    for (size_t i = 1; i < parts.size(); ++i) {
+        size_t equals = parts[i].find('=');
+        string key    = parts[i].substr(0, equals);
+        string item   = equals == string::npos ? string() : parts[i].substr(equals + 1);
+        if (key == "format") {
+            if (item == "alink") {
+                spec.format = ForwardFormat::ALINK;
+            } else if (item == "msp") {
+                spec.format = ForwardFormat::MSP;
+            } else if (item == "binary") {
+                spec.format = ForwardFormat::BINARY;
+            } else if (item == "raw") {
+                spec.format = ForwardFormat::RAW;
+            } else {
+                MSP_THROW(invalid_argument, "Invalid --forward format: " + item);
+            }
+        } else if (key == "rate") {
+            spec.rateHz = parseOptionNumber("forward rate", item, 0, 1000);
+        } else if (key == "batch") {
+            spec.batch = parseOptionNumber("forward batch", item, 1, ForwardingEngine::MAX_BATCH);
+        } else if (key == "cmds" || key == "deny") {
+            for (const string& id : splitList(item, '+')) {
+                MspCommand cmd = static_cast<MspCommand>(
+                    parseOptionNumber("forward " + key, id, 0, MSP_COMMAND_COUNT - 1));
+                (key == "cmds" ? spec.commands : spec.denied).set(cmd);
+            }
+            spec.hasCommands = spec.hasCommands || key == "cmds";
+        } else if (key == "decimate") {
+            // "n" for every command or "cmd:n", combined with '+'
+            for (const string& entry : splitList(item, '+')) {
+                size_t colon = entry.find(':');
+                long   every = parseOptionNumber("forward decimate", entry.substr(colon + 1), 1, UINT16_MAX);
+                if (colon == string::npos) {
+                    fill(begin(spec.decimation), end(spec.decimation), static_cast<uint16_t>(every));
+                } else {
+                    long id = parseOptionNumber("forward decimate", entry.substr(0, colon), 0, MSP_COMMAND_COUNT - 1);
+                    spec.decimation[id] = static_cast<uint16_t>(every);
+                }
+            }
+        } else {
+            MSP_THROW(invalid_argument, "Unknown --forward setting: " + parts[i]);
+        }
+    }
+    return spec;
+}
+
+void loadConfigFile(RuntimeOptions& opts, const string& path);
+
+/**
+ * Apply a single option. Unknown names are rejected so typos don't go unnoticed.
+ */
+void applyOption(RuntimeOptions& opts, const string& name, const string& value) {
+    if (name == "config") {
+        loadConfigFile(opts, value);
+    }
+    else if (name == "source") {
+        size_t colon = value.find(':');
+        if (colon == string::npos || colon == 0 || colon + 1 == value.size()) {
+            MSP_THROW(invalid_argument, "Invalid value for --source (expected type:source): " + value);
+        }
+        opts.sourceSpec = value;
+    }
+    else if (name == "alink-port") {
+        opts.alinkPort = parseOptionNumber(name, value, 0, 65535);
+    }
+    else if (name == "log-level") {
+        if (value != "quiet" && value != "verbose") {
+            MSP_THROW(invalid_argument, "Invalid value for --log-level (quiet or verbose): " + value);
+        }
+        opts.verbose = (value == "verbose");
+    }
+    else if (name == "builtins") {
+        opts.builtins    = MspCommandMask();
+        opts.hasBuiltins = true;
+        for (const string& id : splitList(value, '+')) {
+            MspCommand cmd = static_cast<MspCommand>(parseOptionNumber(name, id, 0, MSP_COMMAND_COUNT - 1));
+            if (!BuiltinExecutorChain::handles(cmd)) {
+                MSP_THROW(invalid_argument, "No built-in executor for command " + id);
+            }
+            opts.builtins.set(cmd);
+        }
+    }
+    else if (name == "udp-batch") {
+        opts.udpBatchSize = parseOptionNumber(name, value, 1, 1024);
+    }
+    else if (name == "udp-timeout") {
+        opts.udpTimeoutMs = parseOptionNumber(name, value, 0, 3600 * 1000);
+    }
+    else if (name == "alink-rate") {
+        opts.alinkRateHz = parseOptionNumber(name, value, 0, 1000);
+    }
+    else if (name == "alink-batch") {
+        opts.alinkBatch = parseOptionNumber(name, value, 1, 16);
+    }
+    else if (name == "alink-deadband") {
+        opts.alinkDeadband = parseOptionNumber(name, value, -1, 65535);
+    }
+    else if (name == "alink-estimate") {
+        opts.alinkEstimateMs = parseOptionNumber(name, value, 0, 60 * 1000);
+    }
+    else if (name == "alink-host") {
+        opts.alinkHost = value;
+    }
+    else if (name == "forward") {
+        opts.forwards.push_back(parseForwardSpec(value));
+    }
+    else if (name == "poll") {
+        for (const string& entry : splitList(value, '+')) {
+            size_t colon = entry.find(':');
+            if (colon == string::npos) {
+                MSP_THROW(invalid_argument, "Invalid value for --poll (expected cmd:hz+...): " + value);
+            }
+            PollSpec spec;
+            spec.command = static_cast<MspCommand>(
+                parseOptionNumber(name, entry.substr(0, colon), 0, MSP_COMMAND_COUNT - 1));
+            spec.rateHz  = parseOptionNumber(name, entry.substr(colon + 1), 1, 1000 / POLL_TICK_MS);
+            opts.polls.push_back(spec);
+        }
+    }
+    else if (name == "poll-inflight") {
+        opts.pollInflight = parseOptionNumber(name, value, 1, MspRequestScheduler::MAX_INFLIGHT);
+    }
+    else if (name == "poll-timeout") {
+        opts.pollTimeoutMs = parseOptionNumber(name, value, 1, 60 * 1000);
+    }
+    else if (name == "baud") {
+        opts.serialBaud = parseOptionNumber(name, value, 1, 4000000);
+    }
+    else if (name == "serial-vmin") {
+        opts.serialMinBytes = parseOptionNumber(name, value, 1, 255);
+    }
+    else if (name == "serial-low-latency") {
+        opts.serialLowLatency = parseOptionNumber(name, value, 0, 1) != 0;
+    }
+    else if (name == "replay-rate") {
+        opts.replayBytesPerSecond = parseOptionNumber(name, value, 0, 1000000000L);
+    }
+    else if (name == "replay-realtime") {
+        opts.replayRealtime = parseOptionNumber(name, value, 0, 1) != 0;
+    }
+    else if (name == "replay-source") {
+        opts.replaySourceId = parseOptionNumber(name, value, -1, UINT16_MAX);
+    }
+    else if (name == "capture") {
+        opts.capturePath = value;
+    }
+    else if (name == "capture-fsync") {
+        opts.captureFsyncEvery = parseOptionNumber(name, value, 0, 1000000);
+    }
+    else if (name == "stats-interval") {
+        opts.statsIntervalMs = parseOptionNumber(name, value, 0, 3600 * 1000);
+    }
+    else if (name == "stats-port") {
+        opts.statsPort = parseOptionNumber(name, value, 0, 65535);
+    }
+    else if (name == "pipeline") {
+        opts.pipeline = parseOptionNumber(name, value, 0, 1) != 0;
+    }
+    else if (name == "parse-cpu") {
+        opts.parseCpu = parseOptionNumber(name, value, -1, CPU_SETSIZE - 1);
+    }
+    else if (name == "exec-cpu") {
+        opts.execCpu = parseOptionNumber(name, value, -1, CPU_SETSIZE - 1);
+    }
+    else if (name == "parse-priority") {
+        opts.parsePriority = parseOptionNumber(name, value, 0, 99);
+    }
+    else if (name == "exec-priority") {
+        opts.execPriority = parseOptionNumber(name, value, 0, 99);
+    }
+    else if (name == "fleet-workers") {
+        opts.fleetWorkers = parseOptionNumber(name, value, 0, CPU_SETSIZE);
+    }
+    else if (name == "fleet-links") {
+        opts.fleetLinks = parseOptionNumber(name, value, 1, 1 << 20);
+    }
+    else if (name == "fleet-idle") {
+        opts.fleetIdleMs = parseOptionNumber(name, value, 0, 3600 * 1000);
+    }
+    else if (name == "fleet-cpu") {
+        opts.fleetCpu = parseOptionNumber(name, value, -1, CPU_SETSIZE - 1);
+    }
+    else if (name == "plugin") {
+        size_t colon = value.find(':');
+        opts.plugins.emplace_back(value.substr(0, colon),
+                                  colon == string::npos ? string() : value.substr(colon + 1));
+    }
+    else if (name == "input") {
+        size_t colon = value.find(':');
+        if (colon == string::npos || colon == 0 || colon + 1 == value.size()) {
+            MSP_THROW(invalid_argument, "Invalid value for --input (expected type:source): " + value);
+        }
+        opts.extraInputs.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+    }
+    else {
+        MSP_THROW(invalid_argument, "Unknown option: --" + name);
+    }
+}
+
+/**
+ * Read a whole (small) file into 'contents'. Returns false if it can't be
+ * opened or read.
+ */
+bool readWholeFile(const string& path, string& contents) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char chunk[512];
+    while (true) {
+        ssize_t bytesRead = read(fd, chunk, sizeof(chunk));
+        if (bytesRead > 0) {
+            contents.append(chunk, static_cast<size_t>(bytesRead));
+        } else if (bytesRead == 0 || errno != EINTR) {
+            close(fd);
+            return bytesRead == 0;
+        }
+    }
+}
+
+/**
+ * Apply the options in a config file, see Runtime Options for the format.
+ * Errors name the file and line.
+ */
+void loadConfigFile(RuntimeOptions& opts, const string& path) {
+    static int depth = 0;
+    if (depth > 0) {
+        MSP_THROW(invalid_argument, "Config files can't load other config files: " + path);
+    }
+    string contents;
+    if (!readWholeFile(path, contents)) {
+        MSP_THROW(runtime_error, "Failed to open config file: " + path);
+    }
+
+    static const char* const BLANKS = " \t\r";
+    size_t next       = 0;
+    int    lineNumber = 0;
+    ++depth;
+    MSP_TRY {
+        while (next < contents.size()) {
+            size_t end  = contents.find('\n', next);
+            string text = contents.substr(next, end == string::npos ? string::npos : end - next);
+            next = end == string::npos ? contents.size() : end + 1;
+            ++lineNumber;
+#ifndef __cpp_exceptions
+            fatalContext() = path + ":" + to_string(lineNumber) + ": ";
+#endif
+            string line = text.substr(0, text.find('#'));
+            size_t start = line.find_first_not_of(BLANKS);
+            if (start == string::npos) {
+                continue;
+            }
+            line = line.substr(start, line.find_last_not_of(BLANKS) - start + 1);
+
+            size_t split = line.find_first_of(string("=") + BLANKS);
+            string name  = line.substr(0, split);
+            size_t from  = split == string::npos ? string::npos : line.find_first_not_of(BLANKS, split);
+            if (from != string::npos && line[from] == '=') {
+                from = line.find_first_not_of(BLANKS, from + 1);
+            }
+            if (name.compare(0, 2, "--") == 0) {
+                name = name.substr(2);
+            }
+            if (from == string::npos) {
+                MSP_THROW(invalid_argument, "Missing value for " + name);
+            }
+            applyOption(opts, name, line.substr(from));
+        }
+#ifndef __cpp_exceptions
+        fatalContext().clear();
+#endif
+    }
+    MSP_CATCH(e) {
+        --depth;
+        MSP_THROW(invalid_argument, path + ":" + to_string(lineNumber) + ": " + e.what());
+    }
+    --depth;
+}
+
+unique_ptr<IInputSource> createInputSource(string inputType, string source, const RuntimeOptions& opts) {
+    if (inputType == "udp") {
+        char* end = nullptr;
+        long udpPort = strtol(source.c_str(), &end, 10);
+        if (end == source.c_str() || *end != '\0' || udpPort <= 0 || udpPort > 65535) {
+            MSP_THROW(invalid_argument, "Invalid UDP port: " + source);
+        }
+        return make_unique<UdpInputSource>(static_cast<int>(udpPort), opts.udpBatchSize, opts.udpTimeoutMs);
+    } 
+    else if (inputType == "serial") {
+        return make_unique<SerialInputSource>(source, opts.serialBaud, opts.serialMinBytes, opts.serialLowLatency);
+    }
+    else if (inputType == "file") {
+        return make_unique<FileInputSource>(source);
+    }
+    else if (inputType == "replay") {
+        return make_unique<ReplayInputSource>(source, opts.replayBytesPerSecond,
+                                              opts.replayRealtime, opts.replaySourceId);
+    } 
+    else {
+        MSP_THROW(invalid_argument, "Invalid input type: " + inputType);
+    }
+
+    return nullptr;
+}
+
+/******************************************************************************
+ *                               Event Loop
+ *
+ * Single-threaded epoll loop multiplexing any number of pollable input
+ * sources (each with its own parser, feeding a shared handler) and periodic
+ * timers backed by timerfd. Sources are switched to non-blocking mode and
+ * drained completely on every wakeup, so batched sources never leave
+ * datagrams stranded in their ring.
+ ******************************************************************************/
+class EventLoop {
+public:
+    EventLoop() {
+        m_epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll < 0) {
+            perror("Failed to create epoll instance");
+            MSP_THROW(runtime_error, "epoll creation failed");
+        }
+    }
+
+    ~EventLoop() {
+        for (auto& entry : m_entries) {
+            if (entry->timerFd >= 0) {
+                close(entry->timerFd);
+            }
+        }
+        if (m_epoll >= 0) {
+            close(m_epoll);
+        }
+    }
+
+    /**
+     * Add an input source; its messages are parsed by a dedicated parser.
+     */
+    void addSource(unique_ptr<IInputSource> source, IMspMessageHandler& handler) {
+        int fd = source->fd();
+        if (fd < 0) {
+            MSP_THROW(invalid_argument, "Input source cannot be polled");
+        }
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            perror("Failed to make input non-blocking");
+            MSP_THROW(runtime_error, "fcntl failed");
+        }
+
+        auto entry    = make_unique<Entry>();
+        entry->source = move(source);
+        entry->parser = make_unique<MspMessageParser>(handler);
+        watch(fd, entry.get());
+        m_entries.push_back(move(entry));
+        ++m_activeSources;
+        m_hasSources = true;
+    }
+
+    /**
+     * Call 'callback' every intervalMs milliseconds.
+     */
+    void addTimer(int intervalMs, function<void()> callback) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            perror("Failed to create timer");
+            MSP_THROW(runtime_error, "timerfd creation failed");
+        }
+
+        itimerspec spec {};
+        spec.it_interval.tv_sec  = intervalMs / 1000;
+        spec.it_interval.tv_nsec = (intervalMs % 1000) * 1000000L;
+        spec.it_value            = spec.it_interval;
+        if (timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+            perror("Failed to arm timer");
+            close(fd);
+            MSP_THROW(runtime_error, "timerfd_settime failed");
+        }
+
+        auto entry      = make_unique<Entry>();
+        entry->timerFd  = fd;
+        entry->callback = move(callback);
+        watch(fd, entry.get());
+        m_entries.push_back(move(entry));
+    }
+
+    /**
+     * Call 'callback' whenever 'fd' (owned by the caller) becomes readable.
+     * The callback must drain it.
+     */
+    void addReader(int fd, function<void()> callback) {
+        auto entry      = make_unique<Entry>();
+        entry->callback = move(callback);
+        watch(fd, entry.get());
+        m_entries.push_back(move(entry));
+    }
+
+    /**
+     * Counters of the per-source parsers.
+     */
+    vector<const ParserStats*> parserStats() const {
+        vector<const ParserStats*> stats;
+        for (const auto& entry : m_entries) {
+            if (entry->parser) {
+                stats.push_back(&entry->parser->stats());
+            }
+        }
+        return stats;
+    }
+
+    /**
+     * Run until stop() is called or every source has failed. A loop without
+     * sources only serves its timers and readers until stop().
+     */
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        m_running = true;
+        while (m_running && (m_activeSources > 0 || !m_hasSources)) {
+            int count = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("epoll_wait failed");
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                Entry* entry = static_cast<Entry*>(events[i].data.ptr);
+                if (entry->source) {
+                    readSource(*entry);
+                } else if (entry->timerFd >= 0) {
+                    fireTimer(*entry);
+                } else {
+                    entry->callback();
+                }
+            }
+        }
+    }
+
+    void stop() {
+        m_running = false;
+    }
+
+private:
+    static const int MAX_EVENTS = 16;
+
+    struct Entry {
+        unique_ptr<IInputSource>     source;
+        unique_ptr<MspMessageParser> parser;
+        int                          timerFd { -1 };
+        function<void()>             callback;
+    };
+
+    int                       m_epoll         { -1 };
+    bool                      m_running       { false };
+    bool                      m_hasSources    { false };
+    size_t                    m_activeSources { 0 };
+    vector<unique_ptr<Entry>> m_entries;
+    uint8_t                   m_buffer[FRAME_BUFFER_SIZE] {};
+
+    void watch(int fd, Entry* entry) {
+        epoll_event event {};
+        event.events   = EPOLLIN;
+        event.data.ptr = entry;
+        if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+            perror("Failed to watch file descriptor");
+            MSP_THROW(runtime_error, "epoll_ctl failed");
+        }
+    }
+
+    void readSource(Entry& entry) {
+        while (true) {
+            const uint8_t* data = nullptr;
+            ssize_t bytesRead = entry.source->receiveView(data, m_buffer, sizeof(m_buffer));
+            if (bytesRead > 0) {
+                entry.parser->processBuffer(data, static_cast<size_t>(bytesRead));
+            } else if (bytesRead == 0) {
+                return; // drained
+            } else {
+                // Broken source: stop watching it, keep serving the others
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, entry.source->fd(), nullptr);
+                --m_activeSources;
+                return;
+            }
+        }
+    }
+
+    void fireTimer(Entry& entry) {
+        uint64_t expirations = 0;
+        if (read(entry.timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            entry.callback();
+        }
+    }
+};
+
+/******************************************************************************
+ *                               Fleet Mode
+ *
+ * Ground station side (native target): terminate the MSP streams of many
+ * vehicles on one UDP port. Each of the --fleet-workers threads owns its own
+ * SO_REUSEPORT socket bound to that port and is pinned to one CPU. The
+ * kernel hashes every sender (address and port) to one of the sockets, so a
+ * vehicle's datagrams always reach the same worker: its state is owned by
+ * that thread alone and nothing on the receive path takes a lock.
+ *
+ * A worker finds the vehicle of a datagram in its FleetLinkTable and feeds
+ * the datagram to that vehicle's own parser. All links of a worker share the
+ * worker's dispatcher, which updates the link's data model per call. The
+ * built-in executors decode into that model; console logs, alink,
+ * forwarding, polling and plugins are single-stream features and not
+ * available in this mode.
+ *
+ * The worker threads only write their own counters; every FLEET_SWEEP_
+ * INTERVAL_MS they drop links idle for longer than --fleet-idle and sum the
+ * parser counters of their links for the stats line.
+ ******************************************************************************/
+struct FleetStats {
+    StatCounter links;     // senders currently tracked
+    StatCounter datagrams; // datagrams received
+    StatCounter rejected;  // datagrams of new senders dropped, the table was full
+    StatCounter expired;   // links dropped after being idle
+};
+
+/**
+ * Per-vehicle state. Large (the parser's frame buffers), so it lives outside
+ * the table's arrays and is only touched once the datagram's slot is found.
+ */
+struct FleetLink {
+    FlightDataModel  model;
+    MspMessageParser parser;
+
+    explicit FleetLink(IMspMessageHandler& handler)
+        : parser(handler)
+    {
+        model.verbose = false; // the log sink has a single producer
+    }
+};
+
+/**
+ * Links by sender, as a structure of arrays: lookups only scan the dense key
+ * array, eight slots per cache line. Open addressing with linear probing and
+ * Fibonacci hashing, kept at most half full; erase() moves the rest of the
+ * probe run back instead of leaving tombstones, so churn never lengthens
+ * the probes. Used by one thread only.
+ */
+class FleetLinkTable {
+public:
+    explicit FleetLinkTable(size_t maxLinks)
+        : m_maxLinks(maxLinks)
+    {
+        size_t slots = 2;
+        m_shift = 63;
+        while (slots < 2 * maxLinks) {
+            slots *= 2;
+            --m_shift;
+        }
+        m_mask = slots - 1;
+        m_keys.assign(slots, 0);
+        m_lastSeenNs.assign(slots, 0);
+        m_links.resize(slots);
+    }
+
+    /**
+     * Key of a sender; never 0, which marks an empty slot.
+     */
+    static uint64_t key(const sockaddr_in& sender) {
+        return 1ULL << 48 | static_cast<uint64_t>(sender.sin_addr.s_addr) << 16 | sender.sin_port;
+    }
+
+    size_t size() const {
+        return m_count;
+    }
+
+    bool full() const {
+        return m_count == m_maxLinks;
+    }
+
+    /**
+     * The link of 'key', or nullptr; marks it as seen at 'nowNs'.
+     */
+    FleetLink* find(uint64_t key, int64_t nowNs) {
+        for (size_t slot = home(key); m_keys[slot] != 0; slot = (slot + 1) & m_mask) {
+            if (m_keys[slot] == key) {
+                m_lastSeenNs[slot] = nowNs;
+                return m_links[slot].get();
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Add the link of a 'key' that isn't in the table. The table must not be full.
+     */
+    void insert(uint64_t key, int64_t nowNs, unique_ptr<FleetLink> link) {
+        size_t slot = home(key);
+        while (m_keys[slot] != 0) {
+            slot = (slot + 1) & m_mask;
+        }
+        m_keys[slot]       = key;
+        m_lastSeenNs[slot] = nowNs;
+        m_links[slot]      = move(link);
+        ++m_count;
+    }
+
+    /**
+     * Drop the links not seen since 'cutoffNs', calling onExpire(link)
+     * first. Returns how many were dropped.
+     */
+    template <typename Callback>
+    size_t expire(int64_t cutoffNs, Callback onExpire) {
+        size_t expired = 0;
+        for (size_t slot = 0; slot <= m_mask;) {
+            if (m_keys[slot] != 0 && m_lastSeenNs[slot] < cutoffNs) {
+                onExpire(*m_links[slot]);
+                erase(slot); // a later link may have moved here, look again
+                ++expired;
+            } else {
+                ++slot;
+            }
+        }
+        return expired;
+    }
+
+    template <typename Callback>
+    void forEach(Callback callback) const {
+        for (size_t slot = 0; slot <= m_mask; ++slot) {
+            if (m_keys[slot] != 0) {
+                callback(*m_links[slot]);
+            }
+        }
+    }
+
+private:
+    size_t   m_maxLinks;
+    size_t   m_count { 0 };
+    size_t   m_mask  { 0 };
+    unsigned m_shift { 63 };
+    vector<uint64_t>              m_keys;       // 0 = empty
+    vector<int64_t>               m_lastSeenNs;
+    vector< unique_ptr<FleetLink> > m_links;
+
+    size_t home(uint64_t key) const {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    void erase(size_t hole) {
+        m_links[hole].reset();
+        for (size_t next = (hole + 1) & m_mask; m_keys[next] != 0; next = (next + 1) & m_mask) {
+            // Move 'next' into the hole unless its home slot lies after the hole
+            if (((next - home(m_keys[next])) & m_mask) >= ((next - hole) & m_mask)) {
+                m_keys[hole]       = m_keys[next];
+                m_lastSeenNs[hole] = m_lastSeenNs[next];
+                m_links[hole]      = move(m_links[next]);
+                hole = next;
+            }
+        }
+        m_keys[hole] = 0;
+        --m_count;
+    }
+};
+
+/**
+ * One receive thread, its socket, its links and its dispatcher. As the
+ * handler of all its parsers it routes each frame to the model of the link
+ * being parsed.
+ */
+class FleetWorker : public IMspMessageHandler {
+public:
+    FleetWorker(int port, size_t maxLinks, int idleMs, int cpu)
+        : m_links(maxLinks)
+        , m_idleNs(static_cast<int64_t>(idleMs) * 1000000LL)
+        , m_cpu(cpu)
+    {
+        m_socket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (m_socket < 0) {
+            perror("Failed to create fleet socket");
+            MSP_THROW(runtime_error, "Socket creation failed");
+        }
+
+        int one = 1;
+        timeval tv {};
+        tv.tv_usec = FLEET_SWEEP_INTERVAL_MS * 1000; // wake up to sweep and to notice stop()
+        if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+            setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+        {
+            perror("Failed to configure fleet socket");
+            close(m_socket);
+            MSP_THROW(runtime_error, "setsockopt failed");
+        }
+
+        sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port        = htons(port);
+        if (bind(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            perror("Failed to bind fleet socket");
+            close(m_socket);
+            MSP_THROW(runtime_error, "Socket binding failed");
+        }
+
+        for (int i = 0; i < FLEET_BATCH; ++i) {
+            m_iovecs[i].iov_base         = &m_ring[i * FRAME_BUFFER_SIZE];
+            m_iovecs[i].iov_len          = FRAME_BUFFER_SIZE;
+            m_msgs[i].msg_hdr.msg_iov    = &m_iovecs[i];
+            m_msgs[i].msg_hdr.msg_iovlen = 1;
+            m_msgs[i].msg_hdr.msg_name   = &m_names[i];
+        }
+    }
+
+    ~FleetWorker() override {
+        stop();
+        if (m_socket >= 0) {
+            close(m_socket);
+        }
+    }
+
+    /**
+     * Before start(): enable executors here. Shared by all links.
+     */
+    MspCommandDispatcher& dispatcher() {
+        return m_dispatcher;
+    }
+
+    const FleetStats& stats() const {
+        return m_stats;
+    }
+
+    /**
+     * Totals of all links the worker had, refreshed every sweep.
+     */
+    const ParserStats& parserStats() const {
+        return m_parserTotals;
+    }
+
+    void start() {
+        if (!m_thread.joinable()) {
+            m_running.store(true, memory_order_relaxed);
+            m_thread = thread(&FleetWorker::run, this);
+        }
+    }
+
+    /**
+     * Stop and join the thread, within one FLEET_SWEEP_INTERVAL_MS.
+     */
+    void stop() {
+        if (m_thread.joinable()) {
+            m_running.store(false, memory_order_relaxed);
+            m_thread.join();
+        }
+    }
+
+    void onMspMessage(const MspMessage& msg) override {
+        m_dispatcher.dispatchMessage(msg, *m_current);
+    }
+
+    const MspCommandMask* interestMask() const override {
+        return &m_dispatcher.interestMask();
+    }
+
+private:
+    static const size_t PARSER_COUNTERS = 6;
+
+    FleetLinkTable       m_links;
+    MspCommandDispatcher m_dispatcher;
+    FlightDataModel*     m_current { nullptr }; // model of the link being parsed
+    int64_t              m_idleNs;
+    int                  m_cpu;
+    int                  m_socket { -1 };
+    thread               m_thread;
+    atomic<bool>         m_running { false };
+    FleetStats           m_stats;
+    ParserStats          m_parserTotals;
+    uint64_t             m_retired[PARSER_COUNTERS] {}; // counters of the dropped links
+
+    mmsghdr     m_msgs[FLEET_BATCH] {};
+    iovec       m_iovecs[FLEET_BATCH] {};
+    sockaddr_in m_names[FLEET_BATCH] {};
+    uint8_t     m_ring[FLEET_BATCH * FRAME_BUFFER_SIZE];
+
+    void run() {
+        configureCurrentThread("fleet", m_cpu, 0);
+        int64_t nextSweepNs = monotonicNs() + FLEET_SWEEP_INTERVAL_MS * 1000000LL;
+        while (m_running.load(memory_order_relaxed)) {
+            for (mmsghdr& msg : m_msgs) {
+                msg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            int received = recvmmsg(m_socket, m_msgs, FLEET_BATCH, MSG_WAITFORONE, nullptr);
+            if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("[FleetWorker] recvmmsg failed");
+            }
+
+            int64_t nowNs = monotonicNs();
+            for (int i = 0; i < received; ++i) {
+                receive(m_names[i], &m_ring[i * FRAME_BUFFER_SIZE], m_msgs[i].msg_len, nowNs);
+            }
+            if (nowNs >= nextSweepNs) {
+                sweep(nowNs);
+                nextSweepNs = nowNs + FLEET_SWEEP_INTERVAL_MS * 1000000LL;
+            }
+        }
+    }
+
+    void receive(const sockaddr_in& sender, const uint8_t* data, size_t len, int64_t nowNs) {
+        m_stats.datagrams.add();
+        uint64_t   key  = FleetLinkTable::key(sender);
+        FleetLink* link = m_links.find(key, nowNs);
+        if (link == nullptr) {
+            if (m_links.full()) {
+                m_stats.rejected.add();
+                return;
+            }
+            unique_ptr<FleetLink> created = make_unique<FleetLink>(*this);
+            link = created.get();
+            m_links.insert(key, nowNs, move(created));
+            m_stats.links.set(m_links.size());
+        }
+        m_current = &link->model;
+        link->parser.processBuffer(data, len);
+    }
+
+    void sweep(int64_t nowNs) {
+        if (m_idleNs > 0) {
+            size_t expired = m_links.expire(nowNs - m_idleNs, [this](const FleetLink& link) {
+                collect(link.parser.stats(), m_retired);
+            });
+            m_stats.expired.add(expired);
+            m_stats.links.set(m_links.size());
+        }
+
+        uint64_t totals[PARSER_COUNTERS];
+        memcpy(totals, m_retired, sizeof(totals));
+        m_links.forEach([&totals](const FleetLink& link) {
+            collect(link.parser.stats(), totals);
+        });
+        m_parserTotals.bytes.set(totals[0]);
+        m_parserTotals.frames.set(totals[1]);
+        m_parserTotals.skipped.set(totals[2]);
+        m_parserTotals.checksumErrors.set(totals[3]);
+        m_parserTotals.resyncs.set(totals[4]);
+        m_parserTotals.oversize.set(totals[5]);
+    }
+
+    static void collect(const ParserStats& stats, uint64_t* totals) {
+        totals[0] += stats.bytes.get();
+        totals[1] += stats.frames.get();
+        totals[2] += stats.skipped.get();
+        totals[3] += stats.checksumErrors.get();
+        totals[4] += stats.resyncs.get();
+        totals[5] += stats.oversize.get();
+    }
+};
+
+/******************************************************************************
+ *                             Stats Reporting
+ *
+ * Collects the counters of every parser, dispatcher and sender and formats
+ * them as one compact line:
+ *
+ *   bytes=.. frames=.. skipped=.. csum_err=.. resync=.. oversize=..
+ *   exec_us=.. cmd105=.. ... alink_sent=.. alink_err=..
+ *
+ * Values are totals since start. Only commands that were seen are listed.
+ * Builds with MSP_EXEC_HISTOGRAMS add one "lat<cmd>.<executor>=count/p50/p99/max"
+ * field (ns, percentiles rounded up to the bucket limit) per executor, and
+ * formatHistograms() dumps the raw buckets.
+ ******************************************************************************/
+class StatsReporter {
+public:
+    static const size_t LINE_SIZE = 2048;
+
+    void addParser(const ParserStats& stats) {
+        m_parsers.push_back(&stats);
+    }
+
+    void addDispatcher(const DispatchStats& stats) {
+        m_dispatchers.push_back(&stats);
+    }
+
+    void addSender(const char* name, const SendStats& stats) {
+        m_senders.emplace_back(name, &stats);
+    }
+
+    void addPipeline(const PipelineStats& stats) {
+        m_pipelines.push_back(&stats);
+    }
+
+    void addModel(const FlightDataModel& model) {
+        m_models.push_back(&model);
+    }
+
+    void addScheduler(const MspRequestScheduler& scheduler) {
+        m_schedulers.push_back(&scheduler);
     }
 
-    /**
-     * Possible states of the MSP parser state machine.
-     */
-    enum class ParserState {
-        IDLE,
-        VERSION,
-        DIRECTION,
-        SIZE,
-        CMD,
-        PAYLOAD,
-        CHECKSUM
-    };
+    void addFleetWorker(const FleetStats& stats) {
+        m_fleet.push_back(&stats);
+    }
+
+    void addCapture(const CaptureStats& stats) {
+        m_captures.push_back(&stats);
+    }
 
     /**
-     * Processes a single byte from the input stream.
+     * Format the stats line into 'out' (LINE_SIZE bytes, newline terminated,
+     * no NUL). Returns its length.
      */
-    void processByte(uint8_t byte) {
-        switch (m_state) {
-        case ParserState::IDLE:
-            if (byte == '$') {
-                m_state = ParserState::VERSION;
-            }
-            break;
+    size_t format(char* out) const {
+        Line line { out, 0 };
 
-        case ParserState::VERSION:
-            if (byte == 'M') {
-                m_state = ParserState::DIRECTION;
-            } else {
-                reset();
-            }
-            break;
+        uint64_t bytes = 0, frames = 0, skipped = 0, checksum = 0, resyncs = 0, oversize = 0;
+        for (const ParserStats* stats : m_parsers) {
+            bytes    += stats->bytes.get();
+            frames   += stats->frames.get();
+            skipped  += stats->skipped.get();
+            checksum += stats->checksumErrors.get();
+            resyncs  += stats->resyncs.get();
+            oversize += stats->oversize.get();
+        }
+        line.field("bytes", bytes);
+        line.field("frames", frames);
+        line.field("skipped", skipped);
+        line.field("csum_err", checksum);
+        line.field("resync", resyncs);
+        line.field("oversize", oversize);
 
-        case ParserState::DIRECTION:
-            if (byte == '<') {
-                m_msg.direction = MspMessage::Direction::OUTBOUND;
-            } else if (byte == '>') {
-                m_msg.direction = MspMessage::Direction::INBOUND;
-            } else {
-                reset();
-                break;
+        uint64_t executorNs = 0;
+        for (const DispatchStats* stats : m_dispatchers) {
+            executorNs += stats->executorNs.get();
+        }
+        line.field("exec_us", executorNs / 1000);
+        for (size_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+            uint64_t count = 0;
+            for (const DispatchStats* stats : m_dispatchers) {
+                count += stats->commands[id].get();
             }
-            m_state = ParserState::SIZE;
-            break;
+            if (count > 0) {
+                line.commandField(id, count);
+            }
+        }
 
-        case ParserState::SIZE:
-            m_msg.size     = byte;
-            m_msg.checksum = byte; // initial checksum includes size
-            m_msg.cmd      = MspCommand::UNKNOWN;
-            m_bufPtr       = 0;
-            if (m_msg.size > MSP_MAX_PAYLOAD_SIZE) {
-                reset();
-            } else {
-                m_state = ParserState::CMD;
+#ifdef MSP_EXEC_HISTOGRAMS
+        for (const DispatchStats* stats : m_dispatchers) {
+            for (const auto& histogram : stats->histograms) {
+                const LatencyHistogram& latency = histogram->latency;
+                if (latency.count() == 0) {
+                    continue;
+                }
+                char name[64];
+                histogramName(name, *histogram);
+                uint64_t values[4] = { latency.count(), latency.percentileLimit(50),
+                                       latency.percentileLimit(99), latency.max() };
+                line.values(name, values, 4, '/');
             }
-            break;
+        }
+#endif
 
-        case ParserState::CMD:
-            m_msg.checksum ^= byte;
-            m_msg.cmd       = toMspCommand(byte);
-            m_bufPtr        = 0;
-            // If size == 0, we move directly to CHECKSUM
-            m_state = (m_msg.size == 0) ? ParserState::CHECKSUM : ParserState::PAYLOAD;
-            break;
+        for (const FlightDataModel* model : m_models) {
+            line.field("model_gen", model->generation());
+        }
 
-        case ParserState::PAYLOAD:
-            m_msg.payload[m_bufPtr++] = byte;
-            m_msg.checksum           ^= byte;
-            if (m_bufPtr == m_msg.size) {
-                m_state = ParserState::CHECKSUM;
+        if (!m_fleet.empty()) {
+            uint64_t links = 0, datagrams = 0, rejected = 0, expired = 0;
+            for (const FleetStats* stats : m_fleet) {
+                links     += stats->links.get();
+                datagrams += stats->datagrams.get();
+                rejected  += stats->rejected.get();
+                expired   += stats->expired.get();
             }
-            break;
+            line.field("fleet_links", links);
+            line.field("fleet_rx", datagrams);
+            line.field("fleet_full", rejected);
+            line.field("fleet_expired", expired);
+            for (size_t i = 0; i < m_fleet.size(); ++i) {
+                // fleet<worker>=links/datagrams, shows how evenly the kernel spreads senders
+                char name[16] = "fleet";
+                name[5 + formatUnsigned(name + 5, i)] = '\0';
+                uint64_t values[2] = { m_fleet[i]->links.get(), m_fleet[i]->datagrams.get() };
+                line.values(name, values, 2, '/');
+            }
+        }
 
-        case ParserState::CHECKSUM:
-            if (m_msg.checksum == byte) {
-                // Valid message
-                m_handler.onMspMessage(m_msg);
+#ifdef MSP_ARENA
+        line.field("arena_kb", g_arenaUsed.load(memory_order_relaxed) / 1024);
+        line.field("steady_allocs", g_arenaSteadyAllocations.load(memory_order_relaxed));
+#endif
+
+        for (const PipelineStats* stats : m_pipelines) {
+            line.field("queued", stats->queued.get());
+            line.field("queue_drop", stats->dropped.get());
+            line.field("queue_oversize", stats->oversize.get());
+        }
+
+        for (const CaptureStats* stats : m_captures) {
+            line.field("capture_rec", stats->records.get());
+            line.field("capture_lost", stats->lost.get());
+        }
+
+        for (const auto& sender : m_senders) {
+            line.field(sender.first, "_sent", sender.second->sent.get());
+            line.field(sender.first, "_err", sender.second->sendErrors.get());
+        }
+
+        for (const MspRequestScheduler* scheduler : m_schedulers) {
+            const PollStats& stats = scheduler->stats();
+            line.field("poll_req", stats.requests.get());
+            line.field("poll_resp", stats.responses.get());
+            line.field("poll_timeout", stats.timeouts.get());
+            line.field("poll_err", stats.sendErrors.get());
+            line.field("poll_stretch", stats.stretch.get());
+            for (size_t i = 0; i < scheduler->commandCount(); ++i) {
+                // poll<cmd>=requests/responses/srtt_us/min_us/max_us
+                const PollCommandStats& command = scheduler->commandStats(i);
+                char name[8] = "poll";
+                name[4 + formatUnsigned(name + 4, static_cast<uint16_t>(scheduler->command(i)))] = '\0';
+                uint64_t values[5] = { command.requests.get(), command.responses.get(), command.rttUs.get(),
+                                       command.minRttUs.get(), command.maxRttUs.get() };
+                line.values(name, values, 5, '/');
             }
-            reset(); // Reset regardless
-            break;
         }
-    }
 
-private:
-    IMspMessageHandler& m_handler;
-    ParserState         m_state { ParserState::IDLE };
-    MspMessage          m_msg   {};
-    uint16_t            m_bufPtr{ 0 };
+        out[line.len++] = '\n';
+        return line.len;
+    }
 
+#ifdef MSP_EXEC_HISTOGRAMS
     /**
-     * Reset the parser to IDLE state.
+     * One "lat<cmd>.<executor>=b0,b1,...,b31" line per executor, bucket i
+     * holding samples below 2^i ns. Same output contract as format().
      */
-    void reset() {
-        m_state = ParserState::IDLE;
-        memset(&m_msg, 0, sizeof(m_msg));
-        m_msg.cmd = MspCommand::UNKNOWN;
-        m_bufPtr  = 0;
+    size_t formatHistograms(char* out) const {
+        Line line { out, 0 };
+        for (const DispatchStats* stats : m_dispatchers) {
+            for (const auto& histogram : stats->histograms) {
+                char name[64];
+                histogramName(name, *histogram);
+                uint64_t buckets[LatencyHistogram::BUCKETS];
+                for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+                    buckets[i] = histogram->latency.bucket(i);
+                }
+                if (!line.fresh) {
+                    if (line.len + 2 >= LINE_SIZE) {
+                        break;
+                    }
+                    out[line.len++] = '\n';
+                    line.fresh = true;
+                }
+                line.values(name, buckets, LatencyHistogram::BUCKETS, ',');
+            }
+        }
+        out[line.len++] = '\n';
+        return line.len;
     }
+#endif
 
+private:
     /**
-     * Convert an integer to our MspCommand enum.
+     * Appends "name=value" fields, leaving room for the final newline.
      */
-    MspCommand toMspCommand(uint8_t cmd) {
-        switch (cmd) {
-        case 101: return MspCommand::STATUS;
-        case 108: return MspCommand::ATTITUDE;
-        case 105: return MspCommand::RC;
-        case 102: return MspCommand::FC_VARIANT;
-        default:  return MspCommand::UNKNOWN;
+    struct Line {
+        char*  out;
+        size_t len;
+        bool   fresh { true }; // no separator before the next field
+
+        void field(const char* name, uint64_t value) {
+            field(name, "", value);
         }
-    }
-};
 
-/******************************************************************************
- *                      Concrete Command Executors
- *
- * Each executor handles a specific MSP command. Extending behavior for new
- * commands simply requires adding a new executor class implementing
- * IMspCommandExecutor.
- ******************************************************************************/
+        void field(const char* name, const char* suffix, uint64_t value) {
+            size_t nameLen   = strlen(name);
+            size_t suffixLen = strlen(suffix);
+            if (len + 1 + nameLen + suffixLen + 1 + 20 + 1 > LINE_SIZE) {
+                return;
+            }
+            separate();
+            memcpy(out + len, name, nameLen);
+            len += nameLen;
+            memcpy(out + len, suffix, suffixLen);
+            len += suffixLen;
+            out[len++] = '=';
+            len += formatUnsigned(out + len, value);
+        }
 
-/**
- * MSP 101 -> STATUS
- */
-class StatusCommandExecutor : public IMspCommandExecutor {
-public:
-    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
-        // Typically, payload[6] bit 0 indicates "armed" in Betaflight
-        if (msg.size > 6) {
-            dataModel.armed = (msg.payload[6] & 0x01);
+        /**
+         * "name=v0<sep>v1<sep>..."
+         */
+        void values(const char* name, const uint64_t* values, size_t count, char separator) {
+            size_t nameLen = strlen(name);
+            if (len + 1 + nameLen + 1 + count * 21 + 1 > LINE_SIZE) {
+                return;
+            }
+            separate();
+            memcpy(out + len, name, nameLen);
+            len += nameLen;
+            out[len++] = '=';
+            for (size_t i = 0; i < count; ++i) {
+                if (i > 0) {
+                    out[len++] = separator;
+                }
+                len += formatUnsigned(out + len, values[i]);
+            }
         }
-        if (dataModel.verbose) {
-            cout << "[StatusCommandExecutor] Armed = " << dataModel.armed << "\n";
+
+        void separate() {
+            if (!fresh) {
+                out[len++] = ' ';
+            }
+            fresh = false;
+        }
+
+        void commandField(size_t id, uint64_t value) {
+            char name[8] = "cmd";
+            name[3 + formatUnsigned(name + 3, id)] = '\0';
+            field(name, value);
         }
+    };
+
+#ifdef MSP_EXEC_HISTOGRAMS
+    static void histogramName(char* name, const ExecutorHistogram& histogram) {
+        size_t len = 0;
+        memcpy(name, "lat", 3);
+        len = 3 + formatUnsigned(name + 3, histogram.command);
+        name[len++] = '.';
+        size_t executorLen = min<size_t>(strlen(histogram.executor), 32);
+        memcpy(name + len, histogram.executor, executorLen);
+        name[len + executorLen] = '\0';
     }
+#endif
+
+    vector<const ParserStats*>   m_parsers;
+    vector<const DispatchStats*> m_dispatchers;
+    vector< pair<const char*, const SendStats*> > m_senders;
+    vector<const PipelineStats*> m_pipelines;
+    vector<const FlightDataModel*> m_models;
+    vector<const MspRequestScheduler*> m_schedulers;
+    vector<const FleetStats*>    m_fleet;
+    vector<const CaptureStats*>  m_captures;
 };
 
 /**
- * MSP 108 -> ATTITUDE
+ * Answers every datagram received on a UDP port with the current stats line,
+ * e.g. "echo | nc -u -w1 <drone> <port>". With MSP_EXEC_HISTOGRAMS a "hist"
+ * query returns the latency buckets instead.
  */
-class AttitudeCommandExecutor : public IMspCommandExecutor {
+class StatsEndpoint {
 public:
-    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
-        if (msg.size >= 6) {
-            dataModel.roll    = *reinterpret_cast<const int16_t*>(&msg.payload[0]);
-            dataModel.pitch   = *reinterpret_cast<const int16_t*>(&msg.payload[2]);
-            dataModel.heading = *reinterpret_cast<const int16_t*>(&msg.payload[4]);
-            if (dataModel.verbose) {
-                cout << "[AttitudeCommandExecutor] pitch:"  << dataModel.pitch
-                     << " roll:"    << dataModel.roll
-                     << " heading:" << dataModel.heading << endl;
-            }
+    StatsEndpoint(int port, const StatsReporter& reporter)
+        : m_reporter(reporter)
+    {
+        m_sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (m_sock < 0) {
+            perror("Failed to create stats socket");
+            MSP_THROW(runtime_error, "Stats socket creation failed");
+        }
+
+        sockaddr_in addr {};
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port        = htons(port);
+        if (bind(m_sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            perror("Failed to bind stats socket");
+            close(m_sock);
+            MSP_THROW(runtime_error, "Stats socket bind failed");
         }
     }
-};
 
-/**
- * MSP 102 -> FC_VARIANT
- */
-class FcVariantCommandExecutor : public IMspCommandExecutor {
-public:
-    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
-        // Usually the first 4 bytes represent the FC variant
-        if (msg.size >= 4) {
-            // Update only if changed
-            if (strncmp(dataModel.fcIdentifier,
-                        reinterpret_cast<const char*>(msg.payload),
-                        4) != 0)
+    ~StatsEndpoint() {
+        if (m_sock >= 0) {
+            close(m_sock);
+        }
+    }
+
+    int fd() const {
+        return m_sock;
+    }
+
+    /**
+     * Answer all pending queries.
+     */
+    void serve() {
+        char request[64];
+        while (true) {
+            sockaddr_in peer {};
+            socklen_t   peerLen = sizeof(peer);
+            ssize_t received = recvfrom(m_sock, request, sizeof(request), 0,
+                                        reinterpret_cast<sockaddr*>(&peer), &peerLen);
+            if (received < 0) {
+                return; // drained
+            }
+            size_t len = 0;
+#ifdef MSP_EXEC_HISTOGRAMS
+            if (received >= 4 && memcmp(request, "hist", 4) == 0) {
+                len = m_reporter.formatHistograms(m_line);
+            } else
+#endif
             {
-                memcpy(dataModel.fcIdentifier, msg.payload, 4);
-                dataModel.fcIdentifier[4] = '\0';
-                if (dataModel.verbose) {
-                    cout << "[FcVariantCommandExecutor] Flight Controller: "
-                         << dataModel.fcIdentifier << "\n";
-                }
+                len = m_reporter.format(m_line);
+            }
+            if (sendto(m_sock, m_line, len, 0, reinterpret_cast<sockaddr*>(&peer), peerLen) < 0) {
+                perror("Failed to send stats reply");
             }
         }
     }
+
+private:
+    const StatsReporter& m_reporter;
+    int                  m_sock { -1 };
+    char                 m_line[StatsReporter::LINE_SIZE];
 };
 
 /**
- * We can chain multiple executors for MSP 105 -> RC.
- * 1) RcCommandConsoleExecutor prints to console,
- * 2) RcCommandUdpExecutor forwards data via UDP to alink_drone.
+ * Print the stats line to stderr with a single write(), so it never
+ * interleaves with the log thread's output.
  */
-class RcCommandConsoleExecutor : public IMspCommandExecutor {
-public:
-    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
-        if (msg.size >= (16 * 2)) {
-            memcpy(dataModel.channels, msg.payload, 16 * sizeof(uint16_t));
-            if (dataModel.verbose) {
-                cout << "[RcCommandConsoleExecutor] Channels:";
-                for (int i = 0; i < CHANNEL_COUNT; i++) {
-                    cout << " " << dataModel.channels[i];
-                }
-                cout << endl;
-            }
-        }
+void printStats(const StatsReporter& reporter) {
+    static const char PREFIX[] = "[stats] ";
+    char   line[sizeof(PREFIX) - 1 + StatsReporter::LINE_SIZE];
+    memcpy(line, PREFIX, sizeof(PREFIX) - 1);
+    size_t len = sizeof(PREFIX) - 1 + reporter.format(line + sizeof(PREFIX) - 1);
+    if (write(STDERR_FILENO, line, len) < 0) {
+        // nothing sensible to do
     }
-};
+}
 
-class RcCommandAlinkForwarder : public IMspCommandExecutor {
+#if defined(MSP_BENCH) || defined(MSP_FUZZ)
+/******************************************************************************
+ *                            Differential Check
+ *
+ * processByte() is the reference state machine; every faster path must
+ * deliver exactly the same frames for any input, however it is split into
+ * buffers. differentialCheck() parses a stream both ways, the fast side in
+ * pseudo-random chunks, and compares the delivered frames one by one (by
+ * content and by their zero-copy views) and the parser counters.
+ *
+ * Used by "bench --differential <rounds>" on the synthetic streams and by
+ * the libFuzzer entry point (-DMSP_FUZZ, make fuzz) on arbitrary input.
+ ******************************************************************************/
+
+/**
+ * Keeps a digest of every delivered frame: FNV-1a over version, direction,
+ * command, payload and raw frame. Also counts views that don't point into
+ * a frame starting with '$'.
+ */
+class FrameRecorder : public IMspMessageHandler {
 public:
-    explicit RcCommandAlinkForwarder(int outPort) {
-        // Create a UDP socket for sending
-        m_sock = socket(AF_INET, SOCK_DGRAM, 0);
-        if (m_sock < 0) {
-            perror("Failed to create output UDP socket");
-            throw runtime_error("Output socket creation failed");
+    explicit FrameRecorder(const MspCommandMask* interest)
+        : m_interest(interest)
+    {
+    }
+
+    void onMspMessage(const MspMessage& msg) override {
+        if (msg.frame == nullptr || msg.frame[0] != '$' ||
+            (msg.size > 0 && (msg.payload < msg.frame || msg.payload + msg.size > msg.frame + msg.frameSize)))
+        {
+            ++badViews;
         }
+        uint64_t hash      = FNV_OFFSET;
+        uint16_t cmd       = static_cast<uint16_t>(msg.cmd);
+        uint8_t  header[6] = { static_cast<uint8_t>(msg.version), static_cast<uint8_t>(msg.direction),
+                               static_cast<uint8_t>(cmd >> 8), static_cast<uint8_t>(cmd),
+                               static_cast<uint8_t>(msg.size >> 8), static_cast<uint8_t>(msg.size) };
+        hash = fnv1a(hash, header, sizeof(header));
+        hash = fnv1a(hash, msg.payload, msg.size);
+        hash = fnv1a(hash, msg.frame, msg.frameSize);
+        frames.push_back(hash);
+    }
 
-        // Prepare destination address (localhost by default)
-        memset(&m_destAddr, 0, sizeof(m_destAddr));
-        m_destAddr.sin_family      = AF_INET;
-        m_destAddr.sin_addr.s_addr = inet_addr("10.5.0.10");
-        m_destAddr.sin_port        = htons(outPort);
+    const MspCommandMask* interestMask() const override {
+        return m_interest;
     }
 
-    ~RcCommandAlinkForwarder() override {
-        if (m_sock >= 0) {
-            close(m_sock);
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+    static uint64_t fnv1a(uint64_t hash, const uint8_t* data, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            hash = (hash ^ data[i]) * 1099511628211ULL;
         }
+        return hash;
     }
 
-    void execute(const MspMessage& msg, FlightDataModel& dataModel) override {
-        if (msg.size >= (16 * 2)) {
-            // channel 9 is the link quality;
-            // channel 11: upper 5 bits - lost packets, lower 5 bits - recovered packets.
-            // other channels are ignored.
+    vector<uint64_t> frames;
+    size_t           badViews { 0 };
 
-            // output format:
-            // TIMESTAMP:LINK_QUALITY:LINK_QUALITY:RECOVERED_PACKETS:LOST_PACKETS:20:20:20:20 (RSSI values are mocked, link quality is just duplicated)
-            
-            uint16_t link_quality = dataModel.channels[10];
+private:
+    const MspCommandMask* m_interest;
+};
 
-            char buffer[128];
-            snprintf(buffer, sizeof(buffer), "%ld:%d:%d:0:0:20:20:20:20\n",
-                     time(nullptr) , link_quality, link_quality);
+/**
+ * Parse 'data' with processByte() and with processBuffer() in chunks drawn
+ * from 'seed' (mostly short, now and then up to 2 KiB). Returns true if
+ * both saw the same; otherwise false with the first difference in 'detail'.
+ * 'interest' (nullptr = all) also exercises the skip paths.
+ */
+bool differentialCheck(const uint8_t* data, size_t len, uint32_t seed,
+                       const MspCommandMask* interest, string& detail)
+{
+    FrameRecorder    reference(interest);
+    FrameRecorder    chunked(interest);
+    MspMessageParser byteParser(reference);
+    MspMessageParser bufferParser(chunked);
 
-            ssize_t sentBytes = sendto(
-                m_sock,
-                buffer,
-                strlen(buffer),
-                0,
-                reinterpret_cast<sockaddr*>(&m_destAddr),
-                sizeof(m_destAddr)
-            );
+    for (size_t i = 0; i < len; ++i) {
+        byteParser.processByte(data[i]);
+    }
+    uint32_t state = seed;
+    for (size_t pos = 0; pos < len;) {
+        state = state * 1664525u + 1013904223u; // LCG, the high bits are good enough
+        uint32_t pick  = state >> 16;
+        size_t   chunk = (pick & 3) == 0 ? 1 : (pick & 3) == 1 ? 1 + (pick >> 2) % 16
+                       : (pick & 3) == 2 ? 1 + (pick >> 2) % 256 : 1 + (pick >> 2) % 2048;
+        chunk = min(chunk, len - pos);
+        bufferParser.processBuffer(data + pos, chunk);
+        pos += chunk;
+    }
 
-            cout << "[RcCommandAlinkForwarder] Sent " << sentBytes << " bytes to alink_drone, message: " << buffer << "\n";
+    const ParserStats& a = byteParser.stats();
+    const ParserStats& b = bufferParser.stats();
+    if (reference.badViews + chunked.badViews > 0) {
+        detail = "frame views outside their frame: " + to_string(reference.badViews) + " processByte, "
+               + to_string(chunked.badViews) + " processBuffer";
+        return false;
+    }
+    size_t common = min(reference.frames.size(), chunked.frames.size());
+    auto   first  = mismatch(reference.frames.begin(), reference.frames.begin() + common,
+                             chunked.frames.begin());
+    if (first.first != reference.frames.begin() + common ||
+        reference.frames.size() != chunked.frames.size())
+    {
+        detail = "frame " + to_string(first.first - reference.frames.begin()) + " differs (processByte "
+               + to_string(reference.frames.size()) + " frames, processBuffer "
+               + to_string(chunked.frames.size()) + ")";
+        return false;
+    }
+    if (a.frames.get() != b.frames.get() || a.skipped.get() != b.skipped.get() ||
+        a.checksumErrors.get() != b.checksumErrors.get() || a.resyncs.get() != b.resyncs.get() ||
+        a.oversize.get() != b.oversize.get())
+    {
+        detail = "counters differ: frames/skipped/csum_err/resync/oversize "
+               + to_string(a.frames.get()) + "/" + to_string(a.skipped.get()) + "/"
+               + to_string(a.checksumErrors.get()) + "/" + to_string(a.resyncs.get()) + "/"
+               + to_string(a.oversize.get()) + " vs " + to_string(b.frames.get()) + "/"
+               + to_string(b.skipped.get()) + "/" + to_string(b.checksumErrors.get()) + "/"
+               + to_string(b.resyncs.get()) + "/" + to_string(b.oversize.get());
+        return false;
+    }
+    return true;
+}
+#endif // MSP_BENCH || MSP_FUZZ
 
-            if (sentBytes < 0) {
-                perror("Failed to send UDP data");
-            }
-        }
+#ifdef MSP_FUZZ
+/**
+ * libFuzzer entry point. The first four bytes seed the chunking and, by
+ * their lowest bit, limit the interest to RC and ATTITUDE; the rest is the
+ * stream. Any difference aborts, which is what the fuzzer reports.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 4) {
+        return 0;
     }
+    uint32_t seed = 0;
+    memcpy(&seed, data, sizeof(seed));
+    MspCommandMask interest;
+    interest.set(MspCommand::RC);
+    interest.set(MspCommand::ATTITUDE);
 
-private:
-    int         m_sock { -1 };
-    sockaddr_in m_destAddr {};
-};
+    string detail;
+    if (!differentialCheck(data + 4, size - 4, seed, (seed & 1) ? &interest : nullptr, detail)) {
+        cerr << "[fuzz] " << detail << "\n";
+        abort();
+    }
+    return 0;
+}
+#endif // MSP_FUZZ
 
+#ifdef MSP_BENCH
 /******************************************************************************
- *                        MSP Command Dispatcher
+ *                               Benchmark
  *
- * Dispatch an MspMessage to the list of executors  * registered for that
- * command. We can add multiple executors per command (chaining).
+ * Built with -DMSP_BENCH (make bench, or BENCH=1 for the platform targets).
+ * Generates a synthetic MSP stream and measures the parser, the dispatcher
+ * and the RC -> alink UDP path:
+ *
+ *   msp_parser bench [--frames n] [--mix s,a,r,f,u] [--unknown-size n]
+ *                    [--corrupt percent] [--corrupt-mode flip|drop|insert|cut|mixed]
+ *                    [--chunk bytes] [--seed n]
+ *
+ * --mix gives the relative weights of STATUS, ATTITUDE, RC, FC_VARIANT and
+ * unknown (displayport-like) frames. --corrupt damages that share of the
+ * frames the way a noisy link does: a flipped byte, a dropped byte, an
+ * inserted byte (often a stray '$') or a frame cut short.
+ *
+ * RC frames carry stick values within RC_VALUE_MIN..RC_VALUE_MAX, except
+ * for BENCH_RC_OUT_OF_RANGE_PCT percent of them with one channel outside,
+ * so the range check rejects about as often as on a real link.
  ******************************************************************************/
-class MspCommandDispatcher {
+static const unsigned BENCH_RC_OUT_OF_RANGE_PCT = 1;
+
+enum class BenchCorruption : uint8_t {
+    FLIP,
+    DROP,
+    INSERT,
+    CUT,
+    MIXED
+};
+
+struct BenchOptions {
+    size_t          frames      { 200000 };
+    unsigned        mix[5]      { 1, 1, 4, 1, 2 };
+    size_t          unknownSize { 32 };
+    double          corruptPct  { 0.0 };
+    BenchCorruption corruption  { BenchCorruption::FLIP };
+    size_t          chunk       { FRAME_BUFFER_SIZE };
+    uint32_t        seed        { 1 };
+    string          startupExe  { "/proc/self/exe" }; // binary to time the cold start of
+    size_t          differential { 0 }; // chunkings to check against processByte() first
+};
+
+/**
+ * Small deterministic PRNG, so streams are identical across targets.
+ */
+class BenchRandom {
 public:
-    explicit MspCommandDispatcher(FlightDataModel& model)
-        : m_dataModel(model)
-    {
-        // Register base executors
-        registerExecutor(MspCommand::STATUS,     make_unique<StatusCommandExecutor>());
-        registerExecutor(MspCommand::ATTITUDE,   make_unique<AttitudeCommandExecutor>());
-        registerExecutor(MspCommand::FC_VARIANT, make_unique<FcVariantCommandExecutor>());
-        // RC executors will be added externally (in main), demonstrating
-        // Open/Closed for easy extension.
-    }
+    explicit BenchRandom(uint32_t seed) : m_state(seed ? seed : 1) {}
 
-    /**
-     * Add an executor for a specific command.
-     * We can add multiple executors for the same command.
-     */
-    void registerExecutor(MspCommand cmd, unique_ptr<IMspCommandExecutor> executor) {
-        m_executors[cmd].push_back(move(executor));
+    uint32_t next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
     }
 
-    /**
-     * Dispatch the message to all executors registered for this command.
-     */
-    void dispatchMessage(const MspMessage& msg) {
-        auto it = m_executors.find(msg.cmd);
-        if (it != m_executors.end()) {
-            for (auto& exec : it->second) {
-                exec->execute(msg, m_dataModel);
-            }
-        }
-        //  else if (m_dataModel.verbose) {
-        //     cout << "[MspCommandDispatcher] Unhandled command: " 
-        //          << static_cast<int>(msg.cmd) << "\n";
-        // }
+    uint32_t below(uint32_t bound) {
+        return next() % bound;
     }
 
 private:
-    FlightDataModel& m_dataModel;
-    // Each command can have multiple executors
-    map<MspCommand, vector< unique_ptr<IMspCommandExecutor> > > m_executors;
+    uint32_t m_state;
 };
 
-/******************************************************************************
- *                     MSP Message Handler Implementation
- *
- * Single Responsibility: Implementation of IMspMessageHandler. Receives fully
- * parsed messages and dispatches them to appropriate executors.
- ******************************************************************************/
-class MspMessageHandler : public IMspMessageHandler {
+/**
+ * Counts the frames it gets; with 'interest' the parser skips the rest, as
+ * it does for a dispatcher.
+ */
+class BenchCountingHandler : public IMspMessageHandler {
 public:
-    explicit MspMessageHandler(FlightDataModel& model)
-        : m_dataModel(model)
-        , m_dispatcher(model)
+    explicit BenchCountingHandler(const MspCommandMask* interest = nullptr)
+        : m_interest(interest)
     {
     }
 
-    void onMspMessage(const MspMessage& msg) override {
-        // if (m_dataModel.verbose) {
-        //     cout << "[MspMessageHandler] Received MSP msg: cmd="
-        //          << static_cast<int>(msg.cmd)
-        //          << ", size=" << static_cast<int>(msg.size) << "\n";
-        // }
-
-        // Dispatch to all interested executors
-        m_dispatcher.dispatchMessage(msg);
+    void onMspMessage(const MspMessage&) override {
+        ++frames;
     }
 
-    /**
-     * Allow external configuration of the command dispatcher.
-     * This is how we register new executors without changing the class.
-     */
-    MspCommandDispatcher& getDispatcher() {
-        return m_dispatcher;
+    const MspCommandMask* interestMask() const override {
+        return m_interest;
     }
 
+    size_t frames { 0 };
+
 private:
-    FlightDataModel       m_dataModel;
-    MspCommandDispatcher  m_dispatcher;
+    const MspCommandMask* m_interest;
 };
 
-/******************************************************************************
- *                         Input Source Interfaces
- *
- * Single Responsibility: Each concrete input source (UDP, file) handles how
- * data is read, while the rest of the code simply calls receiveData().
- * 
- * For Liskov Substitution: UdpInputSource and FileInputSource must behave
- * consistently as IInputSource.
- ******************************************************************************/
-class IInputSource {
+/**
+ * Splits the frames it gets into recovered ones, each matching a different
+ * generated intact frame (by FNV-1a of the raw frame), and false accepts:
+ * damaged frames whose checksum happened to fit.
+ */
+class BenchRecoveryHandler : public IMspMessageHandler {
 public:
-    virtual ~IInputSource() = default;
-    virtual ssize_t receiveData(uint8_t* buffer, size_t bufferSize) = 0;
+    explicit BenchRecoveryHandler(const vector<uint64_t>& intactFrames) {
+        for (uint64_t digest : intactFrames) {
+            ++m_pending[digest];
+        }
+    }
+
+    void onMspMessage(const MspMessage& msg) override {
+        auto it = m_pending.find(FrameRecorder::fnv1a(FrameRecorder::FNV_OFFSET, msg.frame, msg.frameSize));
+        if (it != m_pending.end() && it->second > 0) {
+            --it->second;
+            ++recovered;
+        } else {
+            ++falseAccepts;
+        }
+    }
+
+    size_t recovered    { 0 };
+    size_t falseAccepts { 0 };
+
+private:
+    unordered_map<uint64_t, size_t> m_pending; // digest -> intact frames not seen yet
 };
 
 /**
- * UDP input source
+ * Damage one encoded frame in place ('frame' has room for one more byte).
+ * Returns the new length.
  */
-class UdpInputSource : public IInputSource {
-public:
-    explicit UdpInputSource(int port) {
-        m_socket = socket(AF_INET, SOCK_DGRAM, 0);
-        if (m_socket < 0) {
-            perror("Failed to create UDP socket");
-            throw runtime_error("Socket creation failed");
-        }
+size_t corruptBenchFrame(BenchCorruption kind, BenchRandom& random, uint8_t* frame, size_t len) {
+    if (kind == BenchCorruption::MIXED) {
+        kind = static_cast<BenchCorruption>(random.below(static_cast<uint32_t>(BenchCorruption::MIXED)));
+    }
+    size_t pos = random.below(static_cast<uint32_t>(len));
+    switch (kind) {
+    case BenchCorruption::DROP:
+        memmove(frame + pos, frame + pos + 1, len - pos - 1);
+        return len - 1;
+    case BenchCorruption::INSERT:
+        memmove(frame + pos + 1, frame + pos, len - pos);
+        frame[pos] = random.below(2) ? '$' : static_cast<uint8_t>(random.next());
+        return len + 1;
+    case BenchCorruption::CUT:
+        return pos;
+    default:
+        frame[pos] ^= static_cast<uint8_t>(1 + random.below(255));
+        return len;
+    }
+}
 
-        sockaddr_in serverAddr{};
-        serverAddr.sin_family      = AF_INET;
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-        serverAddr.sin_port        = htons(port);
+/**
+ * Build the synthetic stream. Returns the number of intact frames, i.e. the
+ * ones still in the stream byte for byte (damage in front of the '$' leaves
+ * a frame intact); their digests go to 'intactFrames' unless it's nullptr.
+ */
+size_t buildBenchStream(const BenchOptions& opts, vector<uint8_t>& stream,
+                        vector<uint64_t>* intactFrames = nullptr)
+{
+    static const uint8_t COMMANDS[5] = { 101, 108, 105, 102, 182 };
 
-        if (bind(m_socket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) {
-            perror("Failed to bind UDP socket");
-            close(m_socket);
-            throw runtime_error("Socket binding failed");
-        }
+    BenchRandom random(opts.seed);
+    unsigned    totalWeight = 0;
+    for (unsigned weight : opts.mix) {
+        totalWeight += weight;
+    }
+
+    uint8_t payload[MSP_MAX_PAYLOAD_SIZE];
+    uint8_t frame[MSP_MAX_PAYLOAD_SIZE + MSP_V1_OVERHEAD + 1];
+    uint8_t original[MSP_MAX_PAYLOAD_SIZE + MSP_V1_OVERHEAD];
+    size_t  intact = 0;
 
-        cout << "[UdpInputSource] Listening on UDP port " << port << "...\n";
+    if (intactFrames) {
+        intactFrames->clear();
     }
 
-    ~UdpInputSource() override {
-        if (m_socket >= 0) {
-            close(m_socket);
+    stream.clear();
+    stream.reserve(opts.frames * 24);
+    for (size_t i = 0; i < opts.frames; ++i) {
+        unsigned pick = random.below(totalWeight);
+        size_t   kind = 0;
+        while (pick >= opts.mix[kind]) {
+            pick -= opts.mix[kind++];
+        }
+
+        size_t size = 0;
+        switch (kind) {
+        case 0: size = 11; break;                            // STATUS
+        case 1: size = 6; break;                             // ATTITUDE
+        case 2: size = CHANNEL_COUNT * 2; break;             // RC
+        case 3: size = 4; break;                             // FC_VARIANT
+        default: size = min<size_t>(opts.unknownSize, 255); break;
+        }
+        for (size_t b = 0; b < size; ++b) {
+            payload[b] = static_cast<uint8_t>(random.next());
         }
+        if (kind == 2) {
+            for (size_t c = 0; c < CHANNEL_COUNT; ++c) {
+                if (c != ALINK_QUALITY_CHANNEL && c != ALINK_PACKETS_CHANNEL) {
+                    writeLe16(payload + 2 * c, static_cast<uint16_t>(
+                        RC_VALUE_MIN + random.below(RC_VALUE_MAX - RC_VALUE_MIN + 1)));
+                }
+            }
+            if (random.below(100) < BENCH_RC_OUT_OF_RANGE_PCT) {
+                size_t   c     = random.below(ALINK_QUALITY_CHANNEL); // a stick channel
+                uint16_t value = random.below(2) ? static_cast<uint16_t>(random.below(RC_VALUE_MIN))
+                                                 : static_cast<uint16_t>(RC_VALUE_MAX + 1 + random.below(1000));
+                writeLe16(payload + 2 * c, value);
+            }
+            payload[20] = static_cast<uint8_t>(random.below(4)); // link quality changes now and then
+            payload[21] = 0;
+        }
+
+        size_t len = encodeMspV1(frame, MspMessage::Direction::INBOUND, COMMANDS[kind],
+                                 payload, static_cast<uint8_t>(size));
+        size_t originalLen = len;
+        memcpy(original, frame, len);
+        if (opts.corruptPct > 0 && random.below(1000000) < opts.corruptPct * 10000) {
+            len = corruptBenchFrame(opts.corruption, random, frame, len);
+        }
+        if (search(frame, frame + len, original, original + originalLen) != frame + len) {
+            ++intact;
+            if (intactFrames) {
+                intactFrames->push_back(FrameRecorder::fnv1a(FrameRecorder::FNV_OFFSET, original, originalLen));
+            }
+        }
+        stream.insert(stream.end(), frame, frame + len);
     }
+    return intact;
+}
 
-    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
-        sockaddr_in clientAddr{};
-        socklen_t clientLen = sizeof(clientAddr);
+/**
+ * Print one throughput line.
+ */
+void printBenchResult(const char* name, size_t frames, size_t bytes, int64_t elapsedNs) {
+    double seconds = elapsedNs / 1e9;
+    cout << "[bench] " << name << ": "
+         << static_cast<uint64_t>(frames / seconds) << " frames/s, "
+         << static_cast<double>(elapsedNs) / bytes << " ns/byte\n";
+}
 
-        ssize_t bytesRead = recvfrom(
-            m_socket,
-            buffer,
-            bufferSize,
-            0,
-            reinterpret_cast<sockaddr*>(&clientAddr),
-            &clientLen
-        );
+/**
+ * Median of 'runs' timings of 'body'.
+ */
+template <typename Body>
+int64_t benchTime(int runs, Body body) {
+    vector<int64_t> samples;
+    for (int run = 0; run < runs; ++run) {
+        int64_t start = monotonicNs();
+        body();
+        samples.push_back(monotonicNs() - start);
+    }
+    sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
 
-        if (bytesRead < 0) {
-            perror("Error receiving UDP data");
+/**
+ * Latency from handing an RC frame to the parser until the alink line
+ * arrives on a loopback socket.
+ */
+void benchAlinkLatency(size_t samples) {
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr {};
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen    = sizeof(addr);
+    timeval   timeout {};
+    timeout.tv_usec      = 100000; // a lost datagram costs one sample, not the bench
+    if (receiver < 0 ||
+        bind(receiver, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        getsockname(receiver, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0 ||
+        setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        perror("[bench] loopback socket");
+        if (receiver >= 0) {
+            close(receiver);
         }
+        return;
+    }
 
-        return bytesRead;
+    FlightDataModel model;
+    model.verbose = false;
+    MspMessageHandler handler(model);
+    handler.getDispatcher().enableBuiltin(MspCommand::RC);
+    handler.getDispatcher().registerExecutor(MspCommand::RC,
+        make_unique<RcCommandAlinkForwarder>(ntohs(addr.sin_port), 0, 1, "127.0.0.1"));
+    MspMessageParser parser(handler);
+
+    uint8_t payload[CHANNEL_COUNT * 2] {};
+    uint8_t frame[sizeof(payload) + MSP_V1_OVERHEAD];
+    for (size_t c = 0; c < ALINK_QUALITY_CHANNEL; ++c) {
+        writeLe16(payload + 2 * c, 1500); // sticks centred, within range
+    }
+    char    line[128];
+    vector<int64_t> latencies;
+    for (size_t i = 0; i < samples; ++i) {
+        payload[20] = static_cast<uint8_t>(i); // new link quality: always sent
+        size_t len = encodeMspV1(frame, MspMessage::Direction::INBOUND,
+                                 static_cast<uint8_t>(MspCommand::RC), payload, sizeof(payload));
+        int64_t start = monotonicNs();
+        parser.processBuffer(frame, len);
+        if (recv(receiver, line, sizeof(line), 0) > 0) {
+            latencies.push_back(monotonicNs() - start);
+        }
     }
+    close(receiver);
 
-private:
-    int m_socket { -1 };
-};
+    if (latencies.empty()) {
+        cout << "[bench] rc -> alink udp: no samples\n";
+        return;
+    }
+    sort(latencies.begin(), latencies.end());
+    cout << "[bench] rc -> alink udp: p50 " << latencies[latencies.size() / 2] / 1000.0
+         << " us, p99 " << latencies[latencies.size() * 99 / 100] / 1000.0
+         << " us, max " << latencies.back() / 1000.0 << " us (" << latencies.size() << " samples)\n";
+}
 
 /**
- * File input source
+ * Cold start: run 'exe' on a one-frame file, from fork() until its final
+ * stats line arrives. That line is printed right after the frame went
+ * through parser and dispatcher, so this covers exec, loading, static
+ * initialization and the wiring in main() up to the first parsed frame.
+ * Also reports the size of the binary.
  */
-class FileInputSource : public IInputSource {
-public:
-    explicit FileInputSource(const string& filePath) {
-        m_file.open(filePath, ios::binary);
-        if (!m_file.is_open()) {
-            throw runtime_error("Failed to open file: " + filePath);
+void benchStartup(const string& exe, int runs) {
+    struct stat info {};
+    char path[] = "/tmp/msp_bench_XXXXXX";
+    int  file   = mkstemp(path);
+    if (stat(exe.c_str(), &info) < 0 || file < 0) {
+        perror("[bench] startup");
+        if (file >= 0) {
+            close(file);
+            unlink(path);
         }
-        cout << "[FileInputSource] Reading from file: " << filePath << "...\n";
+        return;
     }
+    static const uint8_t IDENTIFIER[4] = { 'B', 'T', 'F', 'L' };
+    uint8_t frame[sizeof(IDENTIFIER) + MSP_V1_OVERHEAD];
+    size_t  len = encodeMspV1(frame, MspMessage::Direction::INBOUND,
+                              static_cast<uint8_t>(MspCommand::FC_VARIANT), IDENTIFIER, sizeof(IDENTIFIER));
+    bool written = write(file, frame, len) == static_cast<ssize_t>(len);
+    close(file);
 
-    ~FileInputSource() override {
-        if (m_file.is_open()) {
-            m_file.close();
+    vector<int64_t> startups;
+    for (int run = 0; written && run < runs; ++run) {
+        int channel[2];
+        if (pipe2(channel, O_CLOEXEC) < 0) {
+            perror("[bench] pipe");
+            break;
+        }
+        int64_t startNs = monotonicNs();
+        pid_t   child   = fork();
+        if (child == 0) {
+            int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(channel[1], STDERR_FILENO);
+            execl(exe.c_str(), exe.c_str(), "file", path, "--log-level", "quiet",
+                  "--stats-interval", "3600000", static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(channel[1]);
+
+        string  output;
+        char    text[256];
+        ssize_t bytesRead = 0;
+        while (child > 0 && output.find("[stats]") == string::npos &&
+               (bytesRead = read(channel[0], text, sizeof(text))) > 0)
+        {
+            output.append(text, static_cast<size_t>(bytesRead));
+        }
+        int64_t elapsedNs = monotonicNs() - startNs;
+        close(channel[0]);
+        if (child > 0) {
+            waitpid(child, nullptr, 0);
+        }
+        if (output.find("[stats]") != string::npos) {
+            startups.push_back(elapsedNs);
         }
     }
+    unlink(path);
 
-    ssize_t receiveData(uint8_t* buffer, size_t bufferSize) override {
-        if (!m_file.good()) {
-            return -1; // signals EOF or error
+    cout << "[bench] binary: " << exe << " " << info.st_size / 1024 << " KiB\n";
+    if (startups.empty()) {
+        cout << "[bench] startup: no samples\n";
+        return;
+    }
+    sort(startups.begin(), startups.end());
+    cout << "[bench] startup: first frame after p50 " << startups[startups.size() / 2] / 1e6
+         << " ms, min " << startups.front() / 1e6 << " ms (" << startups.size() << " runs)\n";
+}
+
+int runBenchmark(int argc, char* argv[]) {
+    BenchOptions opts;
+    MSP_TRY {
+        for (int i = 0; i + 1 < argc; i += 2) {
+            string name  = argv[i];
+            string value = argv[i + 1];
+            if (name == "--frames") {
+                opts.frames = parseOptionNumber("frames", value, 1, 100000000L);
+            } else if (name == "--unknown-size") {
+                opts.unknownSize = parseOptionNumber("unknown-size", value, 0, 255);
+            } else if (name == "--chunk") {
+                opts.chunk = parseOptionNumber("chunk", value, 1, 1 << 20);
+            } else if (name == "--seed") {
+                opts.seed = parseOptionNumber("seed", value, 0, UINT32_MAX);
+            } else if (name == "--corrupt") {
+                char* end = nullptr;
+                opts.corruptPct = strtod(value.c_str(), &end);
+                if (end == value.c_str() || *end != '\0') {
+                    MSP_THROW(invalid_argument, "Invalid value for --corrupt: " + value);
+                }
+            } else if (name == "--corrupt-mode") {
+                static const char* const MODES[] = { "flip", "drop", "insert", "cut", "mixed" };
+                auto mode = find(begin(MODES), end(MODES), value);
+                if (mode == end(MODES)) {
+                    MSP_THROW(invalid_argument, "Invalid value for --corrupt-mode: " + value);
+                }
+                opts.corruption = static_cast<BenchCorruption>(mode - begin(MODES));
+            } else if (name == "--differential") {
+                opts.differential = parseOptionNumber("differential", value, 0, 1000);
+            } else if (name == "--startup-exe") {
+                opts.startupExe = value;
+            } else if (name == "--mix") {
+                if (sscanf(value.c_str(), "%u,%u,%u,%u,%u", &opts.mix[0], &opts.mix[1],
+                           &opts.mix[2], &opts.mix[3], &opts.mix[4]) != 5 ||
+                    opts.mix[0] + opts.mix[1] + opts.mix[2] + opts.mix[3] + opts.mix[4] == 0)
+                {
+                    MSP_THROW(invalid_argument, "Invalid value for --mix: " + value);
+                }
+            } else {
+                MSP_THROW(invalid_argument, "Unknown bench option: " + name);
+            }
         }
-        m_file.read(reinterpret_cast<char*>(buffer), bufferSize);
-        return m_file.gcount();
+        if (argc % 2 != 0) {
+            MSP_THROW(invalid_argument, string("Missing value for ") + argv[argc - 1]);
+        }
+    }
+    MSP_CATCH(e) {
+        cerr << "[ERROR] " << e.what() << "\n";
+        return 1;
     }
 
-private:
-    ifstream m_file;
-};
+    vector<uint8_t>  stream;
+    vector<uint64_t> intactFrames;
+    size_t intact = buildBenchStream(opts, stream, &intactFrames);
+    cout << "[bench] stream: " << opts.frames << " frames (" << intact << " intact), "
+         << stream.size() << " bytes, chunk " << opts.chunk << "\n";
 
-unique_ptr<IInputSource> createInputSource(string inputType, string source) {
-    if (inputType == "udp") {
-        int udpPort = stoi(source);
-        if (udpPort <= 0 || udpPort > 65535) {
-            throw invalid_argument("Invalid UDP port: " + source);
+    // 0) The fast paths must accept exactly what the reference does
+    if (opts.differential > 0) {
+        MspCommandMask interest; // every other round: what the built-ins want
+        interest.set(MspCommand::STATUS);
+        interest.set(MspCommand::ATTITUDE);
+        interest.set(MspCommand::RC);
+        interest.set(MspCommand::FC_VARIANT);
+        for (size_t round = 0; round < opts.differential; ++round) {
+            string detail;
+            if (!differentialCheck(stream.data(), stream.size(), opts.seed + static_cast<uint32_t>(round),
+                                   (round & 1) ? &interest : nullptr, detail))
+            {
+                cerr << "[bench] differential: round " << round << ": " << detail << "\n";
+                return 1;
+            }
         }
-        return make_unique<UdpInputSource>(udpPort);
-    } 
-    else if (inputType == "file") {
-        return make_unique<FileInputSource>(source);
-    } 
-    else {
-        throw invalid_argument("Invalid input type: " + inputType);
+        cout << "[bench] differential: processBuffer matches processByte in "
+             << opts.differential << " chunkings\n";
     }
 
-    return nullptr;
+    static const int RUNS = 5;
+    size_t accepted = 0;
+
+    // 1) Parser alone, byte at a time (reference state machine)
+    int64_t byteNs = benchTime(RUNS, [&] {
+        BenchCountingHandler counter;
+        MspMessageParser     parser(counter);
+        for (uint8_t byte : stream) {
+            parser.processByte(byte);
+        }
+        accepted = counter.frames;
+    });
+    printBenchResult("parser processByte  ", accepted, stream.size(), byteNs);
+
+    // 2) Parser alone, bulk
+    int64_t bulkNs = benchTime(RUNS, [&] {
+        BenchCountingHandler counter;
+        MspMessageParser     parser(counter);
+        for (size_t pos = 0; pos < stream.size(); pos += opts.chunk) {
+            parser.processBuffer(&stream[pos], min(opts.chunk, stream.size() - pos));
+        }
+        accepted = counter.frames;
+    });
+    printBenchResult("parser processBuffer", accepted, stream.size(), bulkNs);
+    if (intact < opts.frames) {
+        // Untimed pass to tell recovered frames from damaged ones that checked out
+        BenchRecoveryHandler recovery(intactFrames);
+        MspMessageParser     parser(recovery);
+        for (size_t pos = 0; pos < stream.size(); pos += opts.chunk) {
+            parser.processBuffer(&stream[pos], min(opts.chunk, stream.size() - pos));
+        }
+        cout << "[bench] noisy link: " << recovery.recovered << " frames recovered of "
+             << intact << " intact (" << 100.0 * recovery.recovered / max<size_t>(intact, 1) << "%), "
+             << recovery.falseAccepts << " false accepts, "
+             << static_cast<uint64_t>(recovery.recovered / (bulkNs / 1e9)) << " recovered frames/s\n";
+    }
+
+    // 3) Parser + dispatcher with the built-in executors, logging off
+    size_t dispatched = 0;
+    MspCommandMask interest;
+    int64_t dispatchNs = benchTime(RUNS, [&] {
+        FlightDataModel model;
+        model.verbose = false;
+        MspMessageHandler handler(model);
+        handler.getDispatcher().enableBuiltin(MspCommand::RC);
+        MspMessageParser parser(handler);
+        for (size_t pos = 0; pos < stream.size(); pos += opts.chunk) {
+            parser.processBuffer(&stream[pos], min(opts.chunk, stream.size() - pos));
+        }
+        dispatched = parser.stats().frames.get() - parser.stats().skipped.get();
+        interest   = handler.getDispatcher().interestMask();
+    });
+    printBenchResult("parse + dispatch    ", dispatched, stream.size(), dispatchNs);
+
+    //    ... against the parser alone skipping the same commands
+    int64_t maskedNs = benchTime(RUNS, [&] {
+        BenchCountingHandler counter(&interest);
+        MspMessageParser     parser(counter);
+        for (size_t pos = 0; pos < stream.size(); pos += opts.chunk) {
+            parser.processBuffer(&stream[pos], min(opts.chunk, stream.size() - pos));
+        }
+    });
+    if (dispatched > 0) {
+        cout << "[bench] dispatch overhead: "
+             << static_cast<double>(dispatchNs - maskedNs) / dispatched << " ns/frame\n";
+    }
+
+    // 4) End to end: RC frame in, alink line out over loopback UDP
+    benchAlinkLatency(min<size_t>(opts.frames, 10000));
+
+    // 5) Cold start of a whole process, and what it costs in flash
+    benchStartup(opts.startupExe, 20);
+    return 0;
 }
+#endif // MSP_BENCH
 
 /******************************************************************************
  *                               Main Function
@@ -570,78 +6416,425 @@ unique_ptr<IInputSource> createInputSource(string inputType, string source) {
  * Orchestrates the wiring (composition root) of input sources, data model,
  * parser, handler, and executors.
  ******************************************************************************/
+
+/**
+ * Enable the built-in executors picked with --builtins (all by default), and
+ * executor timing only if the stats are reported.
+ */
+void configureDispatcher(MspCommandDispatcher& dispatcher, const RuntimeOptions& options) {
+    dispatcher.setTimed(options.statsIntervalMs > 0 || options.statsPort > 0);
+
+    static const MspCommand BUILTINS[] = {
+        MspCommand::STATUS, MspCommand::ATTITUDE, MspCommand::FC_VARIANT, MspCommand::RC
+    };
+    for (MspCommand cmd : BUILTINS) {
+        if (!options.hasBuiltins || options.builtins.test(static_cast<uint16_t>(cmd))) {
+            dispatcher.enableBuiltin(cmd);
+        } else {
+            dispatcher.disableBuiltin(cmd);
+        }
+    }
+}
+
+/**
+ * Fleet mode: the workers receive and parse on their own threads, this one
+ * only serves the stats. Runs until the process is killed.
+ */
+int runFleet(int port, const RuntimeOptions& options) {
+    int cpus = static_cast<int>(thread::hardware_concurrency());
+    vector< unique_ptr<FleetWorker> > workers;
+    StatsReporter statsReporter;
+    for (int i = 0; i < options.fleetWorkers; ++i) {
+        int cpu = (options.fleetCpu < 0 || cpus <= 0) ? -1 : (options.fleetCpu + i) % cpus;
+        workers.push_back(make_unique<FleetWorker>(port, options.fleetLinks, options.fleetIdleMs, cpu));
+        configureDispatcher(workers.back()->dispatcher(), options);
+        statsReporter.addParser(workers.back()->parserStats());
+        statsReporter.addDispatcher(workers.back()->dispatcher().stats());
+        statsReporter.addFleetWorker(workers.back()->stats());
+    }
+    cout << "[Fleet] " << options.fleetWorkers << " workers on UDP port " << port
+         << ", up to " << options.fleetLinks << " senders each...\n";
+    cout.flush();
+
+    EventLoop loop;
+    if (options.statsIntervalMs > 0) {
+        loop.addTimer(options.statsIntervalMs, [&statsReporter] { printStats(statsReporter); });
+    }
+    unique_ptr<StatsEndpoint> statsEndpoint;
+    if (options.statsPort > 0) {
+        statsEndpoint = make_unique<StatsEndpoint>(options.statsPort, statsReporter);
+        StatsEndpoint* endpoint = statsEndpoint.get();
+        loop.addReader(endpoint->fd(), [endpoint] { endpoint->serve(); });
+    }
+    for (auto& worker : workers) {
+        worker->start();
+    }
+#ifdef MSP_ARENA
+    arenaMarkSteadyState(); // from here on only links of new senders allocate
+#endif
+    loop.run();
+    for (auto& worker : workers) {
+        worker->stop();
+    }
+#ifdef MSP_ARENA
+    arenaReport();
+#endif
+    return 0;
+}
+
+#ifndef MSP_FUZZ // libFuzzer brings its own main()
 int main(int argc, char* argv[]) {
-    // Usage: <exe> <input_type> <source> [out_udp_port]
-    // e.g.   ./msp_parser udp 14555 9999
+    // Usage: <exe> <input_type> <source> [out_udp_port] [--option value ...]
+    // e.g.   ./msp_parser udp 14555 9999 --udp-batch 16
     //        (input from UDP port=14555, output alink commands to port=9999)
-    if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <input_type> <source> [out_udp_port]\n";
-        cerr << "<input_type>: 'udp' or 'file'\n";
-        cerr << "<source>: UDP port or file path\n";
+#ifdef MSP_BENCH
+    if (argc >= 2 && string(argv[1]) == "bench") {
+        return runBenchmark(argc - 2, argv + 2);
+    }
+#endif
+    vector<string> args;
+    RuntimeOptions options;
+    MSP_TRY {
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            if (arg.compare(0, 2, "--") == 0) {
+                if (i + 1 >= argc) {
+                    MSP_THROW(invalid_argument, "Missing value for " + arg);
+                }
+                applyOption(options, arg.substr(2), argv[++i]);
+            } else {
+                args.push_back(arg);
+            }
+        }
+    }
+    MSP_CATCH(e) {
+        cerr << "[ERROR] " << e.what() << "\n";
+        return 1;
+    }
+
+    if (args.size() < 2 && options.sourceSpec.empty()) {
+        cerr << "Usage: " << argv[0] << " <input_type> <source> [out_udp_port] [options]\n";
+        cerr << "       " << argv[0] << " --config <file> [options]\n";
+        cerr << "<input_type>: 'udp', 'serial', 'file' or 'replay' (memory-mapped file)\n";
+        cerr << "<source>: UDP port, serial device or file path\n";
         cerr << "[out_udp_port]: optional UDP port for RC output\n";
+        cerr << "Options:\n";
+        cerr << "  --config <file>     apply the options in a file, one \"name = value\" per line\n";
+        cerr << "  --source <type:src> input instead of <input_type> <source>, e.g. serial:/dev/ttyS2\n";
+        cerr << "  --alink-port <port> instead of [out_udp_port]\n";
+        cerr << "  --builtins <cmd+..> built-in executors to run (default 101+102+105+108)\n";
+        cerr << "  --log-level <quiet|verbose>  per-frame console logs (default verbose)\n";
+        cerr << "  --udp-batch <n>     receive up to n datagrams per syscall (recvmmsg)\n";
+        cerr << "  --udp-timeout <ms>  UDP receive timeout, 0 = wait forever\n";
+        cerr << "  --alink-rate <hz>   max rate of unchanged alink lines, 0 = every RC frame\n";
+        cerr << "  --alink-batch <n>   send up to n alink lines per syscall (sendmmsg)\n";
+        cerr << "  --alink-deadband <n>  only send link quality changes beyond n (-1 = off)\n";
+        cerr << "  --alink-estimate <ms> send smoothed link quality and its minimum over ms\n";
+        cerr << "  --alink-host <addr> alink_drone address for out_udp_port (default 10.5.0.10)\n";
+        cerr << "  --forward <spec>    forward to host:port[,format=alink|msp|binary|raw][,rate=hz]\n";
+        cerr << "                      [,decimate=n|cmd:n+..][,cmds=105+108][,deny=182][,batch=n]\n";
+        cerr << "                      (repeatable)\n";
+        cerr << "  --poll <cmd:hz+..>  request commands from the FC, e.g. 108:50+105:20+101:5\n";
+        cerr << "  --poll-inflight <n> outstanding poll requests at once (default 4)\n";
+        cerr << "  --poll-timeout <ms> give up on a poll request after ms (default 200)\n";
+        cerr << "  --input <type:src>  additional input source, e.g. udp:14556 (repeatable)\n";
+        cerr << "  --plugin <so[:args]>  load an executor plugin, see msp_plugin.h (repeatable)\n";
+        cerr << "  --baud <rate>       serial baud rate (default 115200)\n";
+        cerr << "  --serial-vmin <n>   bytes queued before a serial read wakes up (default 1)\n";
+        cerr << "  --serial-low-latency <0|1>  request ASYNC_LOW_LATENCY (default 1)\n";
+        cerr << "  --replay-rate <B/s> pace raw replay input, 0 = as fast as possible\n";
+        cerr << "  --replay-realtime <0|1>  replay captures at their original timing\n";
+        cerr << "  --replay-source <id>     replay only one capture source (-1 = all)\n";
+        cerr << "  --capture <file>    record all live input to a timestamped capture\n";
+        cerr << "  --capture-fsync <n> fdatasync() the capture every n writes, 0 = never\n";
+        cerr << "  --stats-interval <ms>  print a stats line to stderr this often\n";
+        cerr << "  --stats-port <port>    reply to any UDP datagram with the stats line\n";
+        cerr << "  --pipeline <0|1>    parse and execute on separate threads\n";
+        cerr << "  --parse-cpu <n>     pin the receive/parse thread to a CPU (-1 = any)\n";
+        cerr << "  --exec-cpu <n>      pin the executor thread to a CPU (-1 = any)\n";
+        cerr << "  --parse-priority <n>  SCHED_FIFO priority of the parse thread (0 = normal)\n";
+        cerr << "  --exec-priority <n>   SCHED_FIFO priority of the executor thread (0 = normal)\n";
+        cerr << "  --fleet-workers <n> ground station: n SO_REUSEPORT threads, one parser per sender\n";
+        cerr << "  --fleet-links <n>   senders tracked per fleet worker (default 256)\n";
+        cerr << "  --fleet-idle <ms>   forget senders idle this long, 0 = never (default 10000)\n";
+        cerr << "  --fleet-cpu <n>     pin fleet worker i to CPU n + i, -1 = any (default 0)\n";
         return 1;
     }
 
-    string inputType = argv[1];
-    string source    = argv[2];
+    string inputType, source;
+    if (args.size() >= 2) {
+        inputType = args[0];
+        source    = args[1];
+    } else {
+        size_t colon = options.sourceSpec.find(':');
+        inputType = options.sourceSpec.substr(0, colon);
+        source    = options.sourceSpec.substr(colon + 1);
+    }
 
     // Optional outbound UDP port (for RC data)
-    int outPort = 0;
-    if (argc >= 4) {
-        outPort = stoi(argv[3]);
-        if (outPort <= 0 || outPort > 65535) {
-            cerr << "Invalid outbound UDP port: " << argv[3] << "\n";
+    int outPort = options.alinkPort;
+    if (args.size() >= 3) {
+        char* end = nullptr;
+        outPort = static_cast<int>(strtol(args[2].c_str(), &end, 10));
+        if (end == args[2].c_str() || *end != '\0' || outPort <= 0 || outPort > 65535) {
+            cerr << "Invalid outbound UDP port: " << args[2] << "\n";
             return 1;
         }
     }
 
-    try {
-        // 1) Create input source
-        unique_ptr<IInputSource> inputSource = createInputSource(inputType, source);
+    MSP_TRY {
+        if (outPort > 0 && options.hasBuiltins && !options.builtins.test(static_cast<uint16_t>(MspCommand::RC))) {
+            MSP_THROW(invalid_argument, "alink output needs the RC built-in (105), it decodes the channels");
+        }
+        if (options.alinkEstimateMs > 0 && options.alinkDeadband >= 0) {
+            MSP_THROW(invalid_argument, "--alink-estimate can't be combined with --alink-deadband");
+        }
+        if (options.fleetWorkers > 0) {
+            if (inputType != "udp") {
+                MSP_THROW(invalid_argument, "--fleet-workers needs a udp input");
+            }
+            if (outPort > 0 || !options.forwards.empty() || !options.polls.empty() || !options.plugins.empty() ||
+                !options.extraInputs.empty() || !options.capturePath.empty() || options.pipeline)
+            {
+                MSP_THROW(invalid_argument, "--fleet-workers can't be combined with alink, --forward, --poll, "
+                                            "--plugin, --input, --capture or --pipeline");
+            }
+            return runFleet(static_cast<int>(parseOptionNumber("source", source, 1, 65535)), options);
+        }
+
+        // 1) Create input sources
+        vector< unique_ptr<IInputSource> > inputSources;
+        inputSources.push_back(createInputSource(inputType, source, options));
+        for (const auto& input : options.extraInputs) {
+            inputSources.push_back(createInputSource(input.first, input.second, options));
+        }
+        bool pollable = true;
+        for (const auto& input : inputSources) {
+            pollable = pollable && input->fd() >= 0;
+        }
+        if (!pollable && inputSources.size() > 1) {
+            MSP_THROW(invalid_argument, "File input cannot be combined with other inputs");
+        }
+        if (!pollable && !options.polls.empty()) {
+            MSP_THROW(invalid_argument, "--poll needs a live (udp or serial) input");
+        }
+
+        //    Optionally record everything received, tagged with the input index
+        unique_ptr<CaptureWriter> captureWriter;
+        if (!options.capturePath.empty()) {
+            captureWriter = make_unique<CaptureWriter>(options.capturePath, options.captureFsyncEvery);
+            for (size_t i = 0; i < inputSources.size(); ++i) {
+                inputSources[i] = make_unique<CaptureTeeInputSource>(
+                    std::move(inputSources[i]), *captureWriter, static_cast<uint16_t>(i));
+            }
+        }
+        IInputSource& fcLink = *inputSources.front(); // requests go out where the FC is
 
         // 2) Create the shared data model
         FlightDataModel flightModel;
-        flightModel.verbose = true; // turn on console logs
+        flightModel.verbose = options.verbose; // console logs
 
         // 3) Create the top-level message handler (contains command dispatcher)
         MspMessageHandler messageHandler(flightModel);
 
         // 4) Register RC executors (chaining):
-        //    a) Print to console
-        auto consoleExec = make_unique<RcCommandConsoleExecutor>();
-        messageHandler.getDispatcher().registerExecutor(MspCommand::RC, std::move(consoleExec));
+        //    a) Decode and print to console (built-in, runs first)
+        configureDispatcher(messageHandler.getDispatcher(), options);
 
         //    b) Send to alink if outPort was provided
+        RcCommandAlinkForwarder* alinkForwarder = nullptr;
         if (outPort > 0) {
-            auto alinkExec = make_unique<RcCommandAlinkForwarder>(outPort);
+            auto alinkExec = make_unique<RcCommandAlinkForwarder>(outPort, options.alinkRateHz, options.alinkBatch,
+                                                                  options.alinkHost, options.alinkEstimateMs);
+            alinkForwarder = alinkExec.get();
+            if (options.alinkDeadband >= 0) {
+                alinkForwarder->subscribe(flightModel, options.alinkDeadband);
+            }
             messageHandler.getDispatcher().registerExecutor(MspCommand::RC, std::move(alinkExec));
         }
 
-        // 5) Create our parser, feeding it the message handler
-        MspMessageParser parser(messageHandler);
+        //    c) Fan out to the --forward destinations
+        unique_ptr<ForwardingEngine> forwarding;
+        if (!options.forwards.empty()) {
+            forwarding = make_unique<ForwardingEngine>();
+            forwarding->setLinkEstimate(options.alinkEstimateMs);
+            for (const ForwardSpec& spec : options.forwards) {
+                forwarding->addDestination(spec);
+            }
+            for (uint16_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+                if (forwarding->commands().test(id)) {
+                    messageHandler.getDispatcher().registerExecutor(
+                        static_cast<MspCommand>(id), make_unique<ForwardingExecutor>(*forwarding));
+                }
+            }
+        }
+
+        //    d) Match the responses to our own --poll requests
+        unique_ptr<MspRequestScheduler> scheduler;
+        if (!options.polls.empty()) {
+            scheduler = make_unique<MspRequestScheduler>(fcLink, options.pollInflight, options.pollTimeoutMs);
+            for (const PollSpec& spec : options.polls) {
+                scheduler->addCommand(spec.command, spec.rateHz);
+            }
+            for (uint16_t id = 0; id < MSP_COMMAND_COUNT; ++id) {
+                if (scheduler->commands().test(id)) {
+                    messageHandler.getDispatcher().registerExecutor(
+                        static_cast<MspCommand>(id), make_unique<PollResponseExecutor>(*scheduler));
+                }
+            }
+        }
+
+        //    e) Executor plugins, run after everything above
+        vector< unique_ptr<PluginLibrary> > plugins;
+        for (const auto& plugin : options.plugins) {
+            plugins.push_back(make_unique<PluginLibrary>(plugin.first, plugin.second));
+            plugins.back()->attach(messageHandler.getDispatcher());
+        }
+
+        StatsReporter statsReporter;
+        statsReporter.addDispatcher(messageHandler.getDispatcher().stats());
+        statsReporter.addModel(flightModel);
+        if (alinkForwarder != nullptr) {
+            statsReporter.addSender("alink", alinkForwarder->stats());
+        }
+        for (size_t i = 0; forwarding && i < forwarding->destinationCount(); ++i) {
+            statsReporter.addSender(forwarding->label(i), forwarding->stats(i));
+        }
+        if (scheduler) {
+            statsReporter.addScheduler(*scheduler);
+        }
+        if (captureWriter) {
+            statsReporter.addCapture(captureWriter->stats());
+        }
 
-        // 6) Read data in a loop, parse it byte-by-byte
-        static const size_t BUFFER_SIZE = 1024;
-        uint8_t buffer[BUFFER_SIZE] {};
+        if (pollable) {
+            // 5) Live inputs: one event loop, one parser per source.
+            //    From here on executor output is written by the log thread
+            //    so a slow console can't stall parsing.
+            //    With --pipeline the parsers only queue frames and the
+            //    executors run on their own thread.
+            unique_ptr<PipelinedMessageHandler> pipeline;
+            IMspMessageHandler* parseHandler = &messageHandler;
+            if (options.pipeline) {
+                pipeline     = make_unique<PipelinedMessageHandler>(messageHandler);
+                parseHandler = pipeline.get();
+                statsReporter.addPipeline(pipeline->stats());
+            }
 
-        while (true) {
-            ssize_t bytesRead = inputSource->receiveData(buffer, BUFFER_SIZE);
-            if (bytesRead > 0) {
-                for (ssize_t i = 0; i < bytesRead; ++i) {
-                    parser.processByte(buffer[i]);
+            EventLoop loop;
+            for (auto& input : inputSources) {
+                loop.addSource(std::move(input), *parseHandler);
+            }
+            if (alinkForwarder != nullptr && options.alinkBatch > 1) {
+                // Bound the latency of batched alink lines
+                auto flushAlink = [alinkForwarder] { alinkForwarder->flush(); };
+                if (pipeline) {
+                    pipeline->addPeriodic(ALINK_FLUSH_INTERVAL_MS, flushAlink);
+                } else {
+                    loop.addTimer(ALINK_FLUSH_INTERVAL_MS, flushAlink);
                 }
             }
-            else if (bytesRead == -1 && inputType == "file") {
-                // End of file or error
-                break;
+            if (forwarding && forwarding->batching()) {
+                ForwardingEngine* engine = forwarding.get();
+                auto flushForward = [engine] { engine->flush(); };
+                if (pipeline) {
+                    pipeline->addPeriodic(FORWARD_FLUSH_INTERVAL_MS, flushForward);
+                } else {
+                    loop.addTimer(FORWARD_FLUSH_INTERVAL_MS, flushForward);
+                }
+            }
+            if (scheduler) {
+                // Requests are sent from the thread that sees the responses
+                MspRequestScheduler* poller = scheduler.get();
+                auto tick = [poller] { poller->tick(); };
+                if (pipeline) {
+                    pipeline->addPeriodic(POLL_TICK_MS, tick);
+                } else {
+                    loop.addTimer(POLL_TICK_MS, tick);
+                }
+            }
+            if (captureWriter) {
+                CaptureWriter* writer = captureWriter.get();
+                loop.addTimer(CAPTURE_FLUSH_INTERVAL_MS, [writer] { writer->flush(); });
+            }
+            for (const ParserStats* stats : loop.parserStats()) {
+                statsReporter.addParser(*stats);
+            }
+            if (options.statsIntervalMs > 0) {
+                loop.addTimer(options.statsIntervalMs, [&statsReporter] { printStats(statsReporter); });
+            }
+            unique_ptr<StatsEndpoint> statsEndpoint;
+            if (options.statsPort > 0) {
+                statsEndpoint = make_unique<StatsEndpoint>(options.statsPort, statsReporter);
+                StatsEndpoint* endpoint = statsEndpoint.get();
+                loop.addReader(endpoint->fd(), [endpoint] { endpoint->serve(); });
+            }
+            if (flightModel.verbose) {
+                logSink().start(); // nothing to format otherwise
+            }
+            if (pipeline) {
+                pipeline->start(options.execCpu, options.execPriority);
+            }
+            // Last: threads inherit the affinity and policy of their creator
+            configureCurrentThread("parse", options.parseCpu, options.parsePriority);
+#ifdef MSP_ARENA
+            arenaMarkSteadyState();
+#endif
+            loop.run();
+            if (pipeline) {
+                pipeline->stop();
+            }
+        }
+        else {
+            // 5) File replay: create our parser, feeding it the message handler.
+            //    Output stays synchronous, completeness matters more than latency.
+            //    A capture of several inputs gets one parser per input, as it
+            //    had live, so their partial frames don't run into each other.
+            vector< pair< uint16_t, unique_ptr<MspMessageParser> > > parsers;
+            auto parserFor = [&](uint16_t sourceId) -> MspMessageParser& {
+                for (auto& entry : parsers) {
+                    if (entry.first == sourceId) {
+                        return *entry.second;
+                    }
+                }
+                parsers.emplace_back(sourceId, make_unique<MspMessageParser>(messageHandler));
+                statsReporter.addParser(parsers.back().second->stats());
+                return *parsers.back().second;
+            };
+            parserFor(0);
+            IInputSource& inputSource = *inputSources.front();
+
+            // 6) Read data in a loop, parse it a buffer at a time
+            static const size_t BUFFER_SIZE = FRAME_BUFFER_SIZE;
+            uint8_t buffer[BUFFER_SIZE] {};
+#ifdef MSP_ARENA
+            arenaMarkSteadyState();
+#endif
+
+            while (true) {
+                const uint8_t* data = nullptr;
+                ssize_t bytesRead = inputSource.receiveView(data, buffer, BUFFER_SIZE);
+                if (bytesRead > 0) {
+                    parserFor(inputSource.chunkSource()).processBuffer(data, static_cast<size_t>(bytesRead));
+                }
+                else if (bytesRead == -1) {
+                    // End of file or error
+                    break;
+                }
+            }
+            if (options.statsIntervalMs > 0) {
+                printStats(statsReporter); // final totals
             }
-            // If in UDP mode and bytesRead == 0, we can just keep listening.
         }
     }
-    catch (const exception& e) {
+    MSP_CATCH(e) {
         cerr << "[ERROR] " << e.what() << "\n";
         return 1;
     }
 
+#ifdef MSP_ARENA
+    arenaReport();
+#endif
     return 0;
 }
+#endif // MSP_FUZZ
@@ -0,0 +1,87 @@
+/******************************************************************************
+ *                          msp_parser Plugin ABI
+ *
+ * Executor plugins are shared objects loaded with --plugin <path>[:args].
+ * They only depend on this header, so a plugin built once keeps working
+ * with newer msp_parser builds on the same SoC as long as
+ * MSP_PLUGIN_ABI_VERSION doesn't change.
+ *
+ * A plugin exports one function, msp_plugin_init(), which fills in an
+ * msp_plugin: the commands it wants and the function to call for each of
+ * their frames. msp_parser resolves everything once at startup and calls
+ * on_frame straight from its dispatch table, right after the built-in
+ * executors of the command.
+ *
+ *   #include "msp_plugin.h"
+ *
+ *   static void on_frame(void* context, const msp_plugin_frame* frame) { ... }
+ *
+ *   int msp_plugin_init(msp_plugin* plugin, const char* args) {
+ *       plugin->abi_version = MSP_PLUGIN_ABI_VERSION;
+ *       plugin->name        = "example";
+ *       plugin->on_frame    = on_frame;
+ *       msp_plugin_want(plugin, 105);
+ *       return 0;
+ *   }
+ *
+ * Build with: $(CC) -shared -fPIC -o example.so example.c
+ ******************************************************************************/
+#ifndef MSP_PLUGIN_H
+#define MSP_PLUGIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MSP_PLUGIN_ABI_VERSION 1
+#define MSP_PLUGIN_ENTRY       "msp_plugin_init"
+#define MSP_PLUGIN_COMMANDS    256 /* MSPv1 command IDs; MSPv2 IDs beyond are not dispatched */
+
+/**
+ * Zero-copy view of one validated frame. The pointers are only valid
+ * during the on_frame call; copy what must be kept.
+ */
+typedef struct msp_plugin_frame {
+    uint16_t       command;
+    uint16_t       size;       /* payload bytes */
+    uint8_t        version;    /* 1 = MSPv1, 2 = MSPv2 (also when tunnelled in v1) */
+    uint8_t        direction;  /* '<' request to the FC, '>' response from it */
+    uint16_t       frame_size; /* raw frame bytes, '$' to checksum */
+    const uint8_t* payload;
+    const uint8_t* frame;
+} msp_plugin_frame;
+
+typedef void (*msp_plugin_frame_fn)(void* context, const msp_plugin_frame* frame);
+
+/**
+ * Filled in by msp_plugin_init(). msp_parser zeroes it before the call.
+ */
+typedef struct msp_plugin {
+    uint32_t            abi_version; /* set to MSP_PLUGIN_ABI_VERSION */
+    const char*         name;        /* for stats and log lines, must stay valid */
+    void*               context;     /* passed back to every call */
+    msp_plugin_frame_fn on_frame;    /* called on the executor thread */
+    void              (*shutdown)(void* context); /* optional, before unloading */
+    uint32_t            commands[MSP_PLUGIN_COMMANDS / 32]; /* bit set = deliver */
+} msp_plugin;
+
+static inline void msp_plugin_want(msp_plugin* plugin, uint16_t command) {
+    if (command < MSP_PLUGIN_COMMANDS) {
+        plugin->commands[command >> 5] |= 1u << (command & 31);
+    }
+}
+
+/**
+ * 'args' is the text after ':' in the --plugin value, "" if none.
+ * Return 0 on success; anything else aborts startup.
+ */
+typedef int (*msp_plugin_init_fn)(msp_plugin* plugin, const char* args);
+int msp_plugin_init(msp_plugin* plugin, const char* args);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSP_PLUGIN_H */